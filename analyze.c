@@ -0,0 +1,478 @@
+// analyze.c
+
+// The analyzing execution engine. Rather than working out what an expression
+// is every time it is evaluated, as eval does, analyze looks at it once and
+// builds a tree of nodes, each holding a pointer to the C function that runs
+// it and the operands it needs, already picked out of the cons cells. Lambda
+// bodies are analyzed the first time they are called, and kept with their
+// scope.
+//
+// Frames are the same as the tree walker's, and tail calls are run by the
+// loop in runNode, so they don't use up the C stack.
+
+#include <string.h>
+#include "value.h"
+#include "linkedlist.h"
+#include "talloc.h"
+#include "interpreter.h"
+#include "symbol.h"
+#include "globals.h"
+#include "analyze.h"
+#include "profile.h"
+
+// The profiler's depth when the innermost runNode running started. A closure
+// whose body runNode carries on with replaces any call above it.
+static int nodeBase;
+
+// Runs a node, and then whatever it leaves in tail position, until there is
+// a value
+static Value *runLoop(Node *node, Frame *frame) {
+    while (true) {
+        Node *next = NULL;
+        Value *value = node->run(node, &frame, &next);
+        if (next == NULL) {
+            return value;
+        }
+        node = next;
+    }
+}
+
+// Runs runLoop, recording the calls it makes when profiling
+static Value *runNode(Node *node, Frame *frame) {
+    if (!profiling) {
+        return runLoop(node, frame);
+    }
+    int saved = nodeBase;
+    nodeBase = profileDepth();
+    Value *value = runLoop(node, frame);
+    profileUnwind(nodeBase);
+    nodeBase = saved;
+    return value;
+}
+
+// Returns the frame a local variable lives in
+static Frame *ownerOf(Node *node, Frame *frame) {
+    for (int depth = node->depth; depth > 0; depth--) {
+        frame = frame->parent;
+    }
+    return frame;
+}
+
+static Value *runConstant(Node *node, Frame **frame, Node **next) {
+    return node->value;
+}
+
+static Value *runGlobal(Node *node, Frame **frame, Node **next) {
+    return lookUpSymbol(node->value, *frame);
+}
+
+static Value *runLocal(Node *node, Frame **frame, Node **next) {
+    Value *value = ownerOf(node, *frame)->slots[node->slot];
+    if (value == NULL) {
+        // Used before its define or letrec binding was evaluated
+        evaluationError();
+    }
+    return value;
+}
+
+// Runs a form that was malformed when it was analyzed
+static Value *runError(Node *node, Frame **frame, Node **next) {
+    evaluationError();
+    return NULL;
+}
+
+// (if test then else). A test that doesn't evaluate to a boolean is evaluated
+// again, as evalIf does.
+static Value *runIf(Node *node, Frame **frame, Node **next) {
+    Value *test = runNode(node->nodes[0], *frame);
+    if (test->type != BOOL_TYPE) {
+        test = eval(test, *frame);
+        if (test->type != BOOL_TYPE) {
+            evaluationError();
+        }
+    }
+    *next = test->i == 1 ? node->nodes[1] : node->nodes[2];
+    return NULL;
+}
+
+// A cond clause whose test is a variable, which must be a boolean. The nodes
+// are the test, the body, and the rest of the clauses.
+static Value *runClause(Node *node, Frame **frame, Node **next) {
+    Value *test = runNode(node->nodes[0], *frame);
+    if (test->type != BOOL_TYPE) {
+        evaluationError();
+    }
+    *next = test->i == 1 ? node->nodes[1] : node->nodes[2];
+    return NULL;
+}
+
+// A cond clause with any other test, which is chosen if its i is 1, as in
+// evalCond
+static Value *runClauseOne(Node *node, Frame **frame, Node **next) {
+    Value *test = runNode(node->nodes[0], *frame);
+    *next = test->i == 1 ? node->nodes[1] : node->nodes[2];
+    return NULL;
+}
+
+// (folded <version> replacement original), whose nodes are the replacement
+// and the original. Its value is the version the replacement depends on.
+static Value *runFolded(Node *node, Frame **frame, Node **next) {
+    *next = node->value->i == primitivesVersion ? node->nodes[0] : node->nodes[1];
+    return NULL;
+}
+
+static Value *runBegin(Node *node, Frame **frame, Node **next) {
+    for (int i = 0; i < node->count - 1; i++) {
+        runNode(node->nodes[i], *frame);
+    }
+    *next = node->nodes[node->count - 1];
+    return NULL;
+}
+
+// A let, whose nodes are its bindings and then its body. The bindings are
+// evaluated in the enclosing frame.
+static Value *runLet(Node *node, Frame **frame, Node **next) {
+    Frame *newframe = newFrame(node->value, *frame);
+    for (int i = 0; i < node->count - 1; i++) {
+        newframe->slots[i] = runNode(node->nodes[i], *frame);
+    }
+    *frame = newframe;
+    *next = node->nodes[node->count - 1];
+    return NULL;
+}
+
+// A let* or letrec, whose bindings are evaluated in the new frame
+static Value *runLetStar(Node *node, Frame **frame, Node **next) {
+    Frame *newframe = newFrame(node->value, *frame);
+    for (int i = 0; i < node->count - 1; i++) {
+        newframe->slots[i] = runNode(node->nodes[i], newframe);
+    }
+    *frame = newframe;
+    *next = node->nodes[node->count - 1];
+    return NULL;
+}
+
+static Value *runSetGlobal(Node *node, Frame **frame, Node **next) {
+    Value *value = runNode(node->nodes[0], *frame);
+    setGlobal(findPair(node->value, *frame), value);
+    return makeVoid();
+}
+
+static Value *runSetLocal(Node *node, Frame **frame, Node **next) {
+    Value *value = runNode(node->nodes[0], *frame);
+    Value **slot = &ownerOf(node, *frame)->slots[node->slot];
+    if (*slot == NULL) {
+        evaluationError();
+    }
+    *slot = value;
+    return makeVoid();
+}
+
+static Value *runDefineGlobal(Node *node, Frame **frame, Node **next) {
+    Value *value = runNode(node->nodes[0], *frame);
+    defineGlobal(topFrame(*frame)->globals, node->value, value);
+    return makeVoid();
+}
+
+static Value *runDefineLocal(Node *node, Frame **frame, Node **next) {
+    Value *value = runNode(node->nodes[0], *frame);
+    ownerOf(node, *frame)->slots[node->slot] = value;
+    return makeVoid();
+}
+
+// Makes a closure for (lambda <scope> params body)
+static Value *runLambda(Node *node, Frame **frame, Node **next) {
+    Value *closure = newValue(CLOSURE_TYPE);
+    closure->cl.frame = *frame;
+    closure->cl.scope = car(node->value);
+    closure->cl.functionCode = car(cdr(cdr(node->value)));
+    return closure;
+}
+
+// 'and' and 'or' evaluate all of their arguments, which must be booleans
+static Value *runAnd(Node *node, Frame **frame, Node **next) {
+    bool result = true;
+    for (int i = 0; i < node->count; i++) {
+        Value *value = runNode(node->nodes[i], *frame);
+        if (value->type != BOOL_TYPE) {
+            evaluationError();
+        }
+        if (value->i == 0) {
+            result = false;
+        }
+    }
+    return makeBool(result);
+}
+
+static Value *runOr(Node *node, Frame **frame, Node **next) {
+    bool result = false;
+    for (int i = 0; i < node->count; i++) {
+        Value *value = runNode(node->nodes[i], *frame);
+        if (value->type != BOOL_TYPE) {
+            evaluationError();
+        }
+        if (value->i == 1) {
+            result = true;
+        }
+    }
+    return makeBool(result);
+}
+
+// Returns the analyzed body of a closure, analyzing it on its first call
+static Node *bodyOf(Value *closure) {
+    Value *scope = closure->cl.scope;
+    if (scope->scope.node == NULL) {
+        scope->scope.node = analyze(closure->cl.functionCode);
+    }
+    return scope->scope.node;
+}
+
+// An application, whose nodes are the operator and then the arguments. A
+// closure's body is left in tail position.
+static Value *runCall(Node *node, Frame **frame, Node **next) {
+    Value *function = runNode(node->nodes[0], *frame);
+    int count = node->count - 1;
+    Value *args[node->count];
+    for (int i = 0; i < count; i++) {
+        args[i] = runNode(node->nodes[i + 1], *frame);
+    }
+    if (function->type == CLOSURE_TYPE) {
+        Value *scope = function->cl.scope;
+        if (count != scope->scope.params) {
+            evaluationError();
+        }
+        Frame *newframe = newFrame(scope, function->cl.frame);
+        memcpy(newframe->slots, args, count * sizeof(Value *));
+        *frame = newframe;
+        *next = bodyOf(function);
+        if (profiling) {
+            profileCall(function, nodeBase);
+        }
+        return NULL;
+    } else if (function->type == PRIMITIVE_TYPE) {
+        Value *list = makeEmptyList();
+        for (int i = count - 1; i >= 0; i--) {
+            list = cons(args[i], list);
+        }
+        if (profiling) {
+            return profilePrimitive(function, list);
+        }
+        return function->pf(list);
+    }
+    evaluationError();
+    return NULL;
+}
+
+// Makes a node with room for the given number of nodes
+static Node *makeNode(Value *(*run)(Node *, Frame **, Node **), int count) {
+    Node *node = talloc(sizeof(Node));
+    node->run = run;
+    node->value = NULL;
+    node->depth = 0;
+    node->slot = 0;
+    node->count = count;
+    node->nodes = count > 0 ? talloc(count * sizeof(Node *)) : NULL;
+    return node;
+}
+
+static Node *makeConstant(Value *value) {
+    Node *node = makeNode(runConstant, 0);
+    node->value = value;
+    return node;
+}
+
+// Analyzes every expression of a list into the nodes of a node, starting at
+// the given index
+static void analyzeEach(Value *list, Node *node, int index) {
+    for (; list->type == CONS_TYPE; list = cdr(list)) {
+        node->nodes[index++] = analyze(car(list));
+    }
+}
+
+// Analyzes the expressions of a begin or a cond clause
+static Node *analyzeBody(Value *body) {
+    if (body->type != CONS_TYPE) {
+        return makeConstant(makeVoid());
+    }
+    if (cdr(body)->type != CONS_TYPE) {
+        return analyze(car(body));
+    }
+    Node *node = makeNode(runBegin, length(body));
+    analyzeEach(body, node, 0);
+    return node;
+}
+
+// Analyzes the clauses of a cond into a chain of clause nodes
+static Node *analyzeClauses(Value *clauses) {
+    if (clauses->type != CONS_TYPE) {
+        return makeConstant(makeVoid());
+    }
+    Value *clause = car(clauses);
+    if (clause->type != CONS_TYPE) {
+        return makeNode(runError, 0);
+    }
+    Value *first = car(clause);
+    if (first == elseSymbol) {
+        if (cdr(clauses)->type != NULL_TYPE) {
+            return makeNode(runError, 0);
+        }
+        return analyzeBody(cdr(clause));
+    }
+    Node *node;
+    if (first->type == SYMBOL_TYPE || first->type == LOCAL_TYPE) {
+        node = makeNode(runClause, 3);
+    } else if (first->type == BOOL_TYPE || first->type == CONS_TYPE) {
+        node = makeNode(runClauseOne, 3);
+    } else {
+        return makeNode(runError, 0);
+    }
+    node->nodes[0] = analyze(first);
+    node->nodes[1] = analyzeBody(cdr(clause));
+    node->nodes[2] = analyzeClauses(cdr(clauses));
+    return node;
+}
+
+// Analyzes (let <scope> ((name expr)...) body), and likewise let* and letrec
+static Node *analyzeLet(Value *args, Value *(*run)(Node *, Frame **, Node **)) {
+    if (car(args)->type != SCOPE_TYPE) {
+        return makeNode(runError, 0);
+    }
+    Value *bindings = car(cdr(args));
+    int count = length(bindings);
+    Node *node = makeNode(run, count + 1);
+    node->value = car(args);
+    for (int i = 0; i < count; i++, bindings = cdr(bindings)) {
+        node->nodes[i] = analyze(car(cdr(car(bindings))));
+    }
+    node->nodes[count] = analyze(car(cdr(cdr(args))));
+    return node;
+}
+
+// Analyzes set! or define, which are checked the same way
+static Node *analyzeAssignment(Value *args, Value *(*global)(Node *, Frame **, Node **),
+        Value *(*local)(Node *, Frame **, Node **)) {
+    Value *name = car(args);
+    if (length(args) != 2 || (name->type != SYMBOL_TYPE && name->type != LOCAL_TYPE)) {
+        return makeNode(runError, 0);
+    }
+    Node *node;
+    if (name->type == LOCAL_TYPE) {
+        node = makeNode(local, 1);
+        node->depth = name->local.depth;
+        node->slot = name->local.slot;
+    } else {
+        node = makeNode(global, 1);
+        node->value = name;
+    }
+    node->nodes[0] = analyze(car(cdr(args)));
+    return node;
+}
+
+// Analyzes a special form, given the form its head symbol is tagged with
+static Node *analyzeForm(specialForm form, Value *args) {
+    switch (form) {
+        case IF_FORM: {
+            if (length(args) != 3) {
+                return makeNode(runError, 0);
+            }
+            Node *node = makeNode(runIf, 3);
+            analyzeEach(args, node, 0);
+            return node;
+        }
+        case COND_FORM:
+            return analyzeClauses(args);
+        case LET_FORM:
+            return analyzeLet(args, runLet);
+        case LET_STAR_FORM:
+        case LETREC_FORM:
+            return analyzeLet(args, runLetStar);
+        case BEGIN_FORM:
+            return analyzeBody(args);
+        case FOLDED_FORM: {
+            Node *node = makeNode(runFolded, 2);
+            node->value = car(args);
+            analyzeEach(cdr(args), node, 0);
+            return node;
+        }
+        case SET_BANG_FORM:
+            return analyzeAssignment(args, runSetGlobal, runSetLocal);
+        case DEFINE_FORM:
+            return analyzeAssignment(args, runDefineGlobal, runDefineLocal);
+        case QUOTE_FORM:
+            if (length(args) != 1) {
+                return makeNode(runError, 0);
+            }
+            return makeConstant(car(args));
+        case LAMBDA_FORM: {
+            if (car(args)->type != SCOPE_TYPE) {
+                return makeNode(runError, 0);
+            }
+            Node *node = makeNode(runLambda, 0);
+            node->value = args;
+            return node;
+        }
+        case AND_FORM:
+        case OR_FORM: {
+            if (length(args) < 2) {
+                return makeNode(runError, 0);
+            }
+            Node *node = makeNode(form == AND_FORM ? runAnd : runOr, length(args));
+            analyzeEach(args, node, 0);
+            return node;
+        }
+        default:
+            return makeNode(runError, 0);
+    }
+}
+
+Node *analyze(Value *expr) {
+    switch (expr->type) {
+        case INT_TYPE:
+        case DOUBLE_TYPE:
+        case STR_TYPE:
+        case BOOL_TYPE:
+        case NULL_TYPE:
+        case CLOSURE_TYPE:
+        case PRIMITIVE_TYPE:
+        case VECTOR_TYPE:
+        case HASH_TYPE:
+            return makeConstant(expr);
+        case SYMBOL_TYPE: {
+            Node *node = makeNode(runGlobal, 0);
+            node->value = expr;
+            return node;
+        }
+        case LOCAL_TYPE: {
+            Node *node = makeNode(runLocal, 0);
+            node->depth = expr->local.depth;
+            node->slot = expr->local.slot;
+            return node;
+        }
+        case CONS_TYPE: {
+            Value *head = car(expr);
+            if (head->type == SYMBOL_TYPE && head->sym.form != NO_FORM) {
+                return analyzeForm(head->sym.form, cdr(expr));
+            }
+            if (head->type != SYMBOL_TYPE && head->type != LOCAL_TYPE) {
+                // Like eval, treat anything else as data
+                return makeConstant(expr);
+            }
+            Node *node = makeNode(runCall, length(expr));
+            analyzeEach(expr, node, 0);
+            return node;
+        }
+        default:
+            return makeNode(runError, 0);
+    }
+}
+
+Value *runAnalyzed(Value *expr, Frame *frame) {
+    return runNode(analyze(expr), frame);
+}
+
+// Runs the analyzed body of a closure
+static Value *callAnalyzed(Value *closure, Frame *frame) {
+    return runNode(bodyOf(closure), frame);
+}
+
+Engine analyzer = {runAnalyzed, callAnalyzed};
@@ -0,0 +1,40 @@
+#include "value.h"
+#include "interpreter.h"
+
+#ifndef _ANALYZE
+#define _ANALYZE
+
+// An analyzed expression. Everything eval would work out from the shape of
+// the expression each time it ran, such as which special form it is, how many
+// arguments it has and where its variables live, is worked out once, and run
+// is set to a function that does only what is left.
+//
+// run returns the value of the node in the given frame. A node with a tail
+// position may instead set *next to the node in it, and *frame to the frame
+// that node is run in, and leave the caller to run it.
+struct Node {
+    Value *(*run)(struct Node *node, Frame **frame, struct Node **next);
+    // A constant, a global's name, the scope of a frame, or a lambda
+    Value *value;
+    // Where a local variable lives
+    int depth;
+    int slot;
+    // The nodes this one is made of
+    int count;
+    struct Node **nodes;
+};
+
+typedef struct Node Node;
+
+// Analyzes a resolved expression
+Node *analyze(Value *expr);
+
+// The analyzing execution engine. Analyzes a resolved top-level expression
+// and runs it in the given frame. Produces the same values and errors as
+// eval.
+Value *runAnalyzed(Value *expr, Frame *frame);
+
+// The analyzing engine, which runs expressions with runAnalyzed
+extern Engine analyzer;
+
+#endif
@@ -0,0 +1,249 @@
+// bench.c
+//
+// Runs each benchmark program several times under the interpreter and prints
+// its median wall time and peak resident set size. Both are compared with a
+// saved baseline, and any benchmark that has got slower, or whose peak memory
+// has grown, by more than the allowed margin is reported as a regression,
+// which makes the exit status 1.
+//
+// usage: bench [-n RUNS] [-t PERCENT] [-b BASELINE] [-s] [-f FLAG]...
+//              INTERPRETER FILE...
+//
+// -s saves the results as the new baseline instead of comparing with it, and
+// each -f passes a flag, such as --vm, on to the interpreter.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#define MAX_FLAGS 16
+#define MAX_NAME 256
+
+typedef struct Result {
+    char name[MAX_NAME];
+    double median;
+    long peakKilobytes;
+} Result;
+
+static double seconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+// The benchmark's name is its file name without the directory or extension
+static void benchmarkName(char *path, char *name) {
+    char *slash = strrchr(path, '/');
+    snprintf(name, MAX_NAME, "%s", slash == NULL ? path : slash + 1);
+    char *dot = strrchr(name, '.');
+    if (dot != NULL) {
+        *dot = '\0';
+    }
+}
+
+// Runs the interpreter on the file once, with its output thrown away, and
+// returns whether it succeeded, with the time it took and its peak RSS
+static bool runOnce(char **command, double *elapsed, long *peakKilobytes) {
+    double start = seconds();
+    pid_t child = fork();
+    if (child < 0) {
+        perror("fork");
+        exit(2);
+    }
+    if (child == 0) {
+        int null = open("/dev/null", O_WRONLY);
+        dup2(null, STDOUT_FILENO);
+        execv(command[0], command);
+        perror(command[0]);
+        _exit(127);
+    }
+    int status;
+    struct rusage usage;
+    if (wait4(child, &status, 0, &usage) < 0) {
+        perror("wait4");
+        exit(2);
+    }
+    *elapsed = seconds() - start;
+    *peakKilobytes = usage.ru_maxrss;
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+static int compareDoubles(const void *a, const void *b) {
+    double x = *(const double *) a;
+    double y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+// Looks up a benchmark in the baseline, returning NULL if it isn't there
+static Result *findBaseline(Result *baseline, int count, char *name) {
+    for (int i = 0; i < count; i++) {
+        if (!strcmp(baseline[i].name, name)) {
+            return &baseline[i];
+        }
+    }
+    return NULL;
+}
+
+// Runs a benchmark the given number of times, recording its median time and
+// the largest peak RSS of any run. Returns false if a run failed.
+static bool measure(char **command, int runs, double *times, Result *result) {
+    result->peakKilobytes = 0;
+    for (int r = 0; r < runs; r++) {
+        long peakKilobytes;
+        if (!runOnce(command, &times[r], &peakKilobytes)) {
+            return false;
+        }
+        if (peakKilobytes > result->peakKilobytes) {
+            result->peakKilobytes = peakKilobytes;
+        }
+    }
+    qsort(times, runs, sizeof(double), compareDoubles);
+    result->median = runs % 2 ? times[runs / 2] : (times[runs / 2 - 1] + times[runs / 2]) / 2;
+    return true;
+}
+
+// Prints how much a measurement has changed from the baseline's, and returns
+// whether it has grown by more than the margin
+static bool printChange(double value, double base, double margin) {
+    double change = 100 * (value - base) / base;
+    printf(" %+7.1f%%", change);
+    return change > margin;
+}
+
+// Reads a baseline saved by -s: a line for each benchmark giving its name,
+// median time in seconds and peak RSS in kilobytes
+static Result *readBaseline(char *path, int *count) {
+    *count = 0;
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        return NULL;
+    }
+    int capacity = 16;
+    Result *results = malloc(capacity * sizeof(Result));
+    Result result;
+    while (fscanf(file, "%255s %lf %ld", result.name, &result.median, &result.peakKilobytes) == 3) {
+        if (*count == capacity) {
+            capacity *= 2;
+            results = realloc(results, capacity * sizeof(Result));
+        }
+        results[(*count)++] = result;
+    }
+    fclose(file);
+    return results;
+}
+
+static void usage(char *program) {
+    fprintf(stderr, "usage: %s [-n RUNS] [-t PERCENT] [-b BASELINE] [-s] [-f FLAG]... "
+            "INTERPRETER FILE...\n", program);
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+    int runs = 5;
+    double margin = 10;
+    char *baselinePath = "bench/baseline";
+    bool saving = false;
+    char *flags[MAX_FLAGS];
+    int flagCount = 0;
+
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-'; i++) {
+        if (!strcmp(argv[i], "-s")) {
+            saving = true;
+        } else if (i + 1 == argc) {
+            usage(argv[0]);
+        } else if (!strcmp(argv[i], "-n")) {
+            runs = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-t")) {
+            margin = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "-b")) {
+            baselinePath = argv[++i];
+        } else if (!strcmp(argv[i], "-f") && flagCount < MAX_FLAGS) {
+            flags[flagCount++] = argv[++i];
+        } else {
+            usage(argv[0]);
+        }
+    }
+    if (argc - i < 2 || runs < 1) {
+        usage(argv[0]);
+    }
+    char *interpreter = argv[i++];
+    int fileCount = argc - i;
+    char **files = argv + i;
+
+    int baselineCount;
+    Result *baseline = saving ? NULL : readBaseline(baselinePath, &baselineCount);
+    if (!saving && baseline == NULL) {
+        fprintf(stderr, "no baseline in %s; run with -s to save one\n", baselinePath);
+    }
+
+    // The command is the interpreter, its flags and then the file
+    char *command[MAX_FLAGS + 3];
+    command[0] = interpreter;
+    for (int f = 0; f < flagCount; f++) {
+        command[f + 1] = flags[f];
+    }
+    command[flagCount + 2] = NULL;
+
+    Result *results = malloc(fileCount * sizeof(Result));
+    double *times = malloc(runs * sizeof(double));
+    int regressions = 0;
+    int status = 0;
+    printf("%-12s %10s %10s %10s %8s %10s %8s\n", "benchmark", "median ms", "peak KB",
+            "base ms", "time", "base KB", "memory");
+    for (int b = 0; b < fileCount; b++) {
+        Result *result = &results[b];
+        benchmarkName(files[b], result->name);
+        command[flagCount + 1] = files[b];
+        if (!measure(command, runs, times, result)) {
+            fprintf(stderr, "%s failed\n", files[b]);
+            status = 2;
+            break;
+        }
+
+        printf("%-12s %10.1f %10ld", result->name, 1000 * result->median, result->peakKilobytes);
+        Result *base = baseline == NULL ? NULL : findBaseline(baseline, baselineCount, result->name);
+        if (base != NULL && base->median > 0 && base->peakKilobytes > 0) {
+            printf(" %10.1f", 1000 * base->median);
+            bool slower = printChange(result->median, base->median, margin);
+            printf(" %10ld", base->peakKilobytes);
+            bool larger = printChange(result->peakKilobytes, base->peakKilobytes, margin);
+            if (slower || larger) {
+                printf("  REGRESSION");
+                regressions++;
+            }
+        }
+        printf("\n");
+        fflush(stdout);
+    }
+
+    if (status == 0 && saving) {
+        FILE *file = fopen(baselinePath, "w");
+        if (file == NULL) {
+            perror(baselinePath);
+            status = 2;
+        } else {
+            for (int b = 0; b < fileCount; b++) {
+                fprintf(file, "%s %.6f %ld\n", results[b].name, results[b].median,
+                        results[b].peakKilobytes);
+            }
+            fclose(file);
+            printf("saved baseline to %s\n", baselinePath);
+        }
+    }
+    if (status == 0 && regressions > 0) {
+        printf("%d of %d benchmarks more than %.0f%% slower or larger than the baseline\n",
+                regressions, fileCount, margin);
+        status = 1;
+    }
+    free(baseline);
+    free(results);
+    free(times);
+    return status;
+}
@@ -0,0 +1,269 @@
+// micro.c
+//
+// Microbenchmarks for the interpreter's hot paths, linked against the
+// interpreter's own objects. Each benchmark is run with more and more
+// iterations until a run takes long enough to time, then a few more times,
+// and the fastest time per operation is printed in nanoseconds. Only the
+// benchmarks whose names contain one of the arguments are run, if any are
+// given.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "value.h"
+#include "linkedlist.h"
+#include "talloc.h"
+#include "interpreter.h"
+#include "globals.h"
+#include "symbol.h"
+#include "resolve.h"
+#include "reader.h"
+#include "output.h"
+
+#define MIN_SECONDS 0.1
+#define REPEATS 5
+
+// Results are stored here so the compiler can't drop the work
+static Value *volatile sink;
+static void *volatile blockSink;
+
+static Frame *top;
+// Frames up to 16 deep below the top frame, and scopes with 0 to 8 slots
+static Frame *framesAbove[17];
+static Value *scopes[9];
+
+static Value *identity;
+static Value *adder;
+static Value *plus;
+static Value *twoArgs;
+static Value *oneArg;
+static Value *longList;
+static Value *fewGlobals;
+static Value *manyGlobals;
+
+static double seconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+// Reads, resolves and evaluates one expression in the top frame
+static Value *evalText(char *text) {
+    FILE *stream = fmemopen(text, strlen(text), "r");
+    Reader reader;
+    openStream(&reader, stream);
+    Value *value = eval(resolve(readDatum(&reader)), top);
+    fclose(stream);
+    return value;
+}
+
+static Value *makeScope(int size) {
+    Value *scope = newValue(SCOPE_TYPE);
+    scope->scope.names = makeNull();
+    scope->scope.params = size;
+    scope->scope.size = size;
+    scope->scope.code = NULL;
+    return scope;
+}
+
+static void setUp() {
+    top = newTopFrame();
+    for (int size = 0; size <= 8; size++) {
+        scopes[size] = makeScope(size);
+    }
+    framesAbove[0] = top;
+    for (int depth = 1; depth <= 16; depth++) {
+        framesAbove[depth] = newFrame(scopes[0], framesAbove[depth - 1]);
+    }
+
+    // The primitives are the only globals at first; a thousand more are
+    // defined to see whether lookups slow down as the table fills
+    fewGlobals = intern("car");
+    char name[32];
+    for (int i = 0; i < 1000; i++) {
+        snprintf(name, sizeof(name), "global-%d", i);
+        defineGlobal(top->globals, internCopy(name, strlen(name)), makeInt(i));
+    }
+    manyGlobals = intern("global-500");
+
+    identity = evalText("(lambda (x) x)");
+    adder = evalText("(lambda (a b) (+ a b))");
+    plus = lookUpSymbol(intern("+"), top);
+    oneArg = cons(makeInt(1), makeNull());
+    twoArgs = cons(makeInt(1), cons(makeInt(2), makeNull()));
+
+    longList = makeNull();
+    for (int i = 0; i < 10000; i++) {
+        longList = cons(makeInt(i * 1000), longList);
+    }
+}
+
+static void lookUpAtTop(long n) {
+    for (long i = 0; i < n; i++) {
+        sink = lookUpSymbol(fewGlobals, top);
+    }
+}
+
+static void lookUpDepth4(long n) {
+    for (long i = 0; i < n; i++) {
+        sink = lookUpSymbol(fewGlobals, framesAbove[4]);
+    }
+}
+
+static void lookUpDepth16(long n) {
+    for (long i = 0; i < n; i++) {
+        sink = lookUpSymbol(fewGlobals, framesAbove[16]);
+    }
+}
+
+static void lookUpManyGlobals(long n) {
+    for (long i = 0; i < n; i++) {
+        sink = lookUpSymbol(manyGlobals, top);
+    }
+}
+
+static void newFrame0(long n) {
+    for (long i = 0; i < n; i++) {
+        blockSink = newFrame(scopes[0], top);
+    }
+}
+
+static void newFrame2(long n) {
+    for (long i = 0; i < n; i++) {
+        blockSink = newFrame(scopes[2], top);
+    }
+}
+
+static void newFrame8(long n) {
+    for (long i = 0; i < n; i++) {
+        blockSink = newFrame(scopes[8], top);
+    }
+}
+
+static void applyIdentity(long n) {
+    for (long i = 0; i < n; i++) {
+        sink = apply(identity, oneArg);
+    }
+}
+
+static void applyAdder(long n) {
+    for (long i = 0; i < n; i++) {
+        sink = apply(adder, twoArgs);
+    }
+}
+
+static void applyPlus(long n) {
+    for (long i = 0; i < n; i++) {
+        sink = apply(plus, twoArgs);
+    }
+}
+
+static void consCells(long n) {
+    for (long i = 0; i < n; i++) {
+        sink = cons(oneArg, twoArgs);
+    }
+}
+
+static void talloc16(long n) {
+    for (long i = 0; i < n; i++) {
+        blockSink = talloc(16);
+    }
+}
+
+static void talloc64(long n) {
+    for (long i = 0; i < n; i++) {
+        blockSink = talloc(64);
+    }
+}
+
+// Prints a list of 10,000 integers to /dev/null
+static void printLongList(long n) {
+    for (long i = 0; i < n; i++) {
+        printValue(longList);
+        writeLine();
+    }
+    flushOutput();
+}
+
+typedef struct Benchmark {
+    char *name;
+    void (*run)(long n);
+} Benchmark;
+
+static Benchmark benchmarks[] = {
+    {"lookUpSymbol/top", lookUpAtTop},
+    {"lookUpSymbol/depth-4", lookUpDepth4},
+    {"lookUpSymbol/depth-16", lookUpDepth16},
+    {"lookUpSymbol/1000-globals", lookUpManyGlobals},
+    {"newFrame/0-slots", newFrame0},
+    {"newFrame/2-slots", newFrame2},
+    {"newFrame/8-slots", newFrame8},
+    {"apply/closure-identity", applyIdentity},
+    {"apply/closure-add", applyAdder},
+    {"apply/primitive-add", applyPlus},
+    {"cons", consCells},
+    {"talloc/16-bytes", talloc16},
+    {"talloc/64-bytes", talloc64},
+    {"printValue/10000-list", printLongList},
+};
+
+// Returns the fastest time per operation over several timed runs, each long
+// enough to measure
+static double measure(Benchmark *benchmark) {
+    long n = 1;
+    double elapsed = 0;
+    while (true) {
+        double start = seconds();
+        benchmark->run(n);
+        elapsed = seconds() - start;
+        if (elapsed >= MIN_SECONDS) {
+            break;
+        }
+        n *= elapsed < MIN_SECONDS / 10 ? 10 : 2;
+    }
+    double best = elapsed / n;
+    for (int i = 1; i < REPEATS; i++) {
+        double start = seconds();
+        benchmark->run(n);
+        double perOperation = (seconds() - start) / n;
+        if (perOperation < best) {
+            best = perOperation;
+        }
+    }
+    return best;
+}
+
+static bool selected(char *name, int argc, char **argv) {
+    if (argc == 1) {
+        return true;
+    }
+    for (int i = 1; i < argc; i++) {
+        if (strstr(name, argv[i]) != NULL) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int main(int argc, char **argv) {
+    setUp();
+
+    // What printValue writes goes to /dev/null, and the results to stderr
+    int null = open("/dev/null", O_WRONLY);
+    dup2(null, STDOUT_FILENO);
+
+    fprintf(stderr, "%-28s %12s\n", "benchmark", "ns/op");
+    int count = sizeof(benchmarks) / sizeof(benchmarks[0]);
+    for (int i = 0; i < count; i++) {
+        if (selected(benchmarks[i].name, argc, argv)) {
+            double perOperation = measure(&benchmarks[i]);
+            fprintf(stderr, "%-28s %12.1f\n", benchmarks[i].name, 1e9 * perOperation);
+        }
+    }
+    tfree();
+    return 0;
+}
@@ -0,0 +1,436 @@
+// fold.c
+
+// Constant folding and dead branch pruning, done on each top-level
+// expression before it runs. Expressions are folded in place where the result
+// is always right, and otherwise put in (folded <version> replacement
+// original) forms, which fall back to the original once a primitive they
+// depended on is rebound.
+
+#include <stdint.h>
+#include "value.h"
+#include "linkedlist.h"
+#include "talloc.h"
+#include "symbol.h"
+#include "globals.h"
+#include "interpreter.h"
+#include "fold.h"
+
+bool folding = true;
+
+// What a foldable primitive does, which says when it would raise an error
+typedef enum {ADD, SUBTRACT, MULTIPLY, DIVIDE, MODULO, COMPARE} operation;
+
+// The primitives that can be folded: those whose value depends only on their
+// arguments, and whose errors can be checked for before calling them. Each
+// name's symbol is interned the first time fold runs, and marked foldable so
+// that setGlobal knows rebinding it makes folded code stale.
+typedef struct Foldable {
+    char *name;
+    Value *(*function)(Value *args);
+    operation op;
+    Value *symbol;
+} Foldable;
+
+static Foldable foldables[] = {
+    {"+", primitiveAdd, ADD},
+    {"-", primitiveSubtract, SUBTRACT},
+    {"*", primitiveMult, MULTIPLY},
+    {"/", primitiveDivide, DIVIDE},
+    {"%", primitiveModulo, MODULO},
+    {"<", primitiveLessThan, COMPARE},
+    {">", primitiveGreaterThan, COMPARE},
+    {"=", primitiveEqualTo, COMPARE},
+    {"<=", primitiveLessThanEqualTo, COMPARE},
+    {">=", primitiveGreaterThanEqualTo, COMPARE},
+};
+
+#define FOLDABLES (sizeof(foldables) / sizeof(foldables[0]))
+
+static Frame *topLevel;
+// The primitivesVersion the expression being folded depends on
+static uint32_t version;
+
+static Value *foldExpr(Value *expr);
+
+static bool isNumber(Value *value) {
+    return value->type == INT_TYPE || value->type == DOUBLE_TYPE;
+}
+
+// Returns true if the value evaluates to itself and can't be changed, so it
+// can stand in for a variable bound to it
+static bool isConstant(Value *value) {
+    return isNumber(value) || value->type == BOOL_TYPE || value->type == STR_TYPE;
+}
+
+// Returns true if the expression is a binding form the resolver has given a
+// scope, as (lambda <scope> ...) or (let <scope> ...)
+static bool isResolved(Value *expr) {
+    return cdr(expr)->type == CONS_TYPE && car(cdr(expr))->type == SCOPE_TYPE;
+}
+
+// Returns true if the expression is one the pass has already folded
+static bool isFolded(Value *expr) {
+    return expr->type == CONS_TYPE && car(expr) == foldedSymbol;
+}
+
+// Puts a folded expression in place of the original, to be used for as long
+// as the primitives stay bound as they are now
+static Value *guard(Value *replacement, Value *original) {
+    return cons(foldedSymbol, cons(makeInt(version), cons(replacement, cons(original, makeNull()))));
+}
+
+// Returns what an expression is known to evaluate to while the primitives
+// stay bound: its replacement if it has been folded, and itself otherwise
+static Value *knownValue(Value *expr) {
+    return isFolded(expr) ? car(cdr(cdr(expr))) : expr;
+}
+
+// Returns the foldable primitive an operator names, or NULL if it isn't one,
+// or its global no longer holds the primitive
+static Foldable *findFoldable(Value *operator) {
+    for (size_t i = 0; i < FOLDABLES; i++) {
+        if (foldables[i].symbol == operator) {
+            Value *pair = findGlobal(topLevel->globals, operator);
+            if (pair == NULL) {
+                return NULL;
+            }
+            Value *value = car(cdr(pair));
+            if (value->type == PRIMITIVE_TYPE && value->pf == foldables[i].function) {
+                return &foldables[i];
+            }
+            return NULL;
+        }
+    }
+    return NULL;
+}
+
+// Returns true if calling the primitive on the arguments, all numbers, gives
+// a value rather than an evaluation error
+static bool canApply(Foldable *foldable, Value *args) {
+    int count = length(args);
+    int64_t result = foldable->op == MULTIPLY ? 1 : 0;
+    switch (foldable->op) {
+        case ADD:
+        case MULTIPLY:
+            // Only the integers before the first double are added or
+            // multiplied exactly, so only they can overflow
+            for (; args->type != NULL_TYPE && car(args)->type == INT_TYPE; args = cdr(args)) {
+                if (foldable->op == ADD ? __builtin_add_overflow(result, car(args)->i, &result)
+                        : __builtin_mul_overflow(result, car(args)->i, &result)) {
+                    return false;
+                }
+            }
+            return true;
+        case SUBTRACT:
+            // A single argument is subtracted from zero
+            if (count == 0) {
+                return false;
+            }
+            if (count > 1) {
+                if (car(args)->type != INT_TYPE) {
+                    return true;
+                }
+                result = car(args)->i;
+                args = cdr(args);
+            }
+            for (; args->type != NULL_TYPE && car(args)->type == INT_TYPE; args = cdr(args)) {
+                if (__builtin_sub_overflow(result, car(args)->i, &result)) {
+                    return false;
+                }
+            }
+            return true;
+        case DIVIDE:
+        case MODULO:
+            if (count != 2) {
+                return false;
+            }
+            if (car(args)->type != INT_TYPE || car(cdr(args))->type != INT_TYPE) {
+                return foldable->op == DIVIDE;
+            }
+            return car(cdr(args))->i != 0 && (car(cdr(args))->i != -1 || car(args)->i != INT64_MIN);
+        default:
+            return count == 2;
+    }
+}
+
+// Folds every element of a list in place
+static void foldEach(Value *list) {
+    for (Value *current = list; current->type == CONS_TYPE; current = cdr(current)) {
+        current->c.car = foldExpr(car(current));
+    }
+}
+
+// Returns false if the variable in the given slot of the frame depth frames
+// up is assigned by define or set!, or called, anywhere in the expression
+static bool onlyRead(Value *expr, int depth, int slot) {
+    if (expr->type != CONS_TYPE) {
+        return true;
+    }
+    Value *head = car(expr);
+    if (head == quoteSymbol || head == tickSymbol) {
+        return true;
+    }
+    if (head->type == LOCAL_TYPE && head->local.depth == depth && head->local.slot == slot) {
+        return false;
+    }
+    if ((head == defineSymbol || head == setBangSymbol) && cdr(expr)->type == CONS_TYPE) {
+        Value *target = car(cdr(expr));
+        if (target->type == LOCAL_TYPE && target->local.depth == depth && target->local.slot == slot) {
+            return false;
+        }
+    }
+    if ((head == lambdaSymbol || head == letSymbol || head == letStarSymbol || head == letRecSymbol)
+            && isResolved(expr)) {
+        Value *bindings = car(cdr(cdr(expr)));
+        if (head == letSymbol) {
+            for (; bindings->type == CONS_TYPE; bindings = cdr(bindings)) {
+                if (!onlyRead(car(cdr(car(bindings))), depth, slot)) {
+                    return false;
+                }
+            }
+        } else if (head != lambdaSymbol) {
+            for (; bindings->type == CONS_TYPE; bindings = cdr(bindings)) {
+                if (!onlyRead(car(cdr(car(bindings))), depth + 1, slot)) {
+                    return false;
+                }
+            }
+        }
+        return onlyRead(car(cdr(cdr(cdr(expr)))), depth + 1, slot);
+    }
+    for (Value *current = expr; current->type == CONS_TYPE; current = cdr(current)) {
+        if (!onlyRead(car(current), depth, slot)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Replaces the variables of the frame depth frames up that have constants
+// with them. If the frame is being removed, references to frames above it
+// are one frame nearer.
+static Value *substitute(Value *expr, int depth, Value **constants, bool removing) {
+    if (expr->type == LOCAL_TYPE) {
+        if (expr->local.depth == depth && constants[expr->local.slot] != NULL) {
+            return constants[expr->local.slot];
+        }
+        if (removing && expr->local.depth > depth) {
+            expr->local.depth--;
+        }
+        return expr;
+    }
+    if (expr->type != CONS_TYPE) {
+        return expr;
+    }
+    Value *head = car(expr);
+    if (head == quoteSymbol || head == tickSymbol) {
+        return expr;
+    }
+    if ((head == lambdaSymbol || head == letSymbol || head == letStarSymbol || head == letRecSymbol)
+            && isResolved(expr)) {
+        Value *bindings = car(cdr(cdr(expr)));
+        if (head != lambdaSymbol) {
+            int inner = head == letSymbol ? depth : depth + 1;
+            for (; bindings->type == CONS_TYPE; bindings = cdr(bindings)) {
+                Value *value = cdr(car(bindings));
+                value->c.car = substitute(car(value), inner, constants, removing);
+            }
+        }
+        Value *body = cdr(cdr(cdr(expr)));
+        body->c.car = substitute(car(body), depth + 1, constants, removing);
+        return expr;
+    }
+    for (Value *current = expr; current->type == CONS_TYPE; current = cdr(current)) {
+        current->c.car = substitute(car(current), depth, constants, removing);
+    }
+    return expr;
+}
+
+// Inlines the variables of a resolved let, with its bindings already folded,
+// that are bound to constants and only ever read. Returns the let's body if
+// that leaves the let's frame with nothing in it, and the let otherwise.
+// Variables bound to folded expressions are left alone, since once a
+// primitive was rebound, their originals would be evaluated at every use.
+static Value *inlineLet(Value *expr) {
+    Value *scope = car(cdr(expr));
+    Value *bindings = car(cdr(cdr(expr)));
+    Value *body = car(cdr(cdr(cdr(expr))));
+    Value **constants = talloc((scope->scope.size + 1) * sizeof(Value *));
+    int inlined = 0;
+    int slot = 0;
+    for (; bindings->type == CONS_TYPE; bindings = cdr(bindings), slot++) {
+        Value *value = car(cdr(car(bindings)));
+        constants[slot] = NULL;
+        if (isConstant(value) && onlyRead(body, 0, slot)) {
+            constants[slot] = value;
+            inlined++;
+        }
+    }
+    for (; slot < scope->scope.size; slot++) {
+        constants[slot] = NULL;
+    }
+    if (inlined == 0) {
+        return expr;
+    }
+    bool removing = inlined == scope->scope.size;
+    body = substitute(body, 0, constants, removing);
+    if (removing) {
+        return body;
+    }
+    cdr(cdr(cdr(expr)))->c.car = body;
+    return expr;
+}
+
+// Folds the clauses of a cond in place, and drops those that can't be taken.
+// Returns what the cond should be replaced by. The clauses kept are put in a
+// new cond, so that if dropping them relied on a folded test, the cond as it
+// was is still there to fall back to.
+static Value *foldCond(Value *expr) {
+    for (Value *clauses = cdr(expr); clauses->type == CONS_TYPE; clauses = cdr(clauses)) {
+        Value *clause = car(clauses);
+        if (clause->type != CONS_TYPE) {
+            return expr;
+        }
+        // cond treats a test that is a list differently from a constant one,
+        // so a test is only replaced by a boolean or another list
+        Value *test = foldExpr(car(clause));
+        if (test->type == BOOL_TYPE || test->type == CONS_TYPE) {
+            clause->c.car = test;
+        }
+        foldEach(cdr(clause));
+    }
+
+    Value *pruned = cons(car(expr), makeNull());
+    Value *kept = pruned;
+    bool dropped = false;
+    bool guarded = false;
+    for (Value *clauses = cdr(expr); clauses->type == CONS_TYPE; clauses = cdr(clauses)) {
+        Value *test = knownValue(car(car(clauses)));
+        if (test->type == BOOL_TYPE) {
+            guarded = guarded || isFolded(car(car(clauses)));
+            if (!test->i) {
+                dropped = true;
+                continue;
+            }
+        }
+        kept->c.cdr = cons(car(clauses), makeNull());
+        kept = cdr(kept);
+        if ((test->type == BOOL_TYPE && test->i) || (test == elseSymbol && cdr(clauses)->type == NULL_TYPE)) {
+            dropped = dropped || cdr(clauses)->type != NULL_TYPE;
+            break;
+        }
+    }
+
+    // If the first clause left is always taken, the cond is just its body
+    Value *clauses = cdr(pruned);
+    if (clauses->type == CONS_TYPE) {
+        Value *test = knownValue(car(car(clauses)));
+        Value *body = cdr(car(clauses));
+        if (((test->type == BOOL_TYPE && test->i) || test == elseSymbol) && body->type == CONS_TYPE
+                && cdr(clauses)->type == NULL_TYPE) {
+            pruned = cdr(body)->type == NULL_TYPE ? car(body) : cons(beginSymbol, body);
+            dropped = true;
+        }
+    }
+    if (!dropped) {
+        return expr;
+    }
+    return guarded ? guard(pruned, expr) : pruned;
+}
+
+// Folds one expression, returning what should replace it
+static Value *foldExpr(Value *expr) {
+    if (expr->type != CONS_TYPE) {
+        return expr;
+    }
+    Value *head = car(expr);
+    if (head->type != SYMBOL_TYPE && head->type != LOCAL_TYPE) {
+        // Data, which eval returns as it is
+        return expr;
+    }
+    if (head->type == LOCAL_TYPE || !isSpecialForm(head)) {
+        foldEach(cdr(expr));
+        Foldable *foldable = head->type == SYMBOL_TYPE ? findFoldable(head) : NULL;
+        if (foldable == NULL) {
+            return expr;
+        }
+        // The arguments' values, in a list of their own so the call is
+        // still there to fall back to
+        Value *values = makeNull();
+        Value *last = NULL;
+        for (Value *args = cdr(expr); args->type == CONS_TYPE; args = cdr(args)) {
+            Value *value = knownValue(car(args));
+            if (!isNumber(value)) {
+                return expr;
+            }
+            Value *cell = cons(value, makeNull());
+            if (last == NULL) {
+                values = cell;
+            } else {
+                last->c.cdr = cell;
+            }
+            last = cell;
+        }
+        if (!canApply(foldable, values)) {
+            return expr;
+        }
+        return guard(foldable->function(values), expr);
+    }
+    if (head == quoteSymbol || head == tickSymbol || head == foldedSymbol) {
+        return expr;
+    }
+    if (head == lambdaSymbol) {
+        if (isResolved(expr)) {
+            foldEach(cdr(cdr(cdr(expr))));
+        }
+        return expr;
+    }
+    if (head == letSymbol || head == letStarSymbol || head == letRecSymbol) {
+        if (!isResolved(expr)) {
+            return expr;
+        }
+        for (Value *bindings = car(cdr(cdr(expr))); bindings->type == CONS_TYPE; bindings = cdr(bindings)) {
+            foldEach(cdr(car(bindings)));
+        }
+        if (head == letSymbol) {
+            Value *inlined = inlineLet(expr);
+            if (inlined != expr) {
+                return foldExpr(inlined);
+            }
+        }
+        foldEach(cdr(cdr(cdr(expr))));
+        return expr;
+    }
+    if (head == condSymbol) {
+        return foldCond(expr);
+    }
+    if (head == defineSymbol || head == setBangSymbol) {
+        if (cdr(expr)->type == CONS_TYPE) {
+            foldEach(cdr(cdr(expr)));
+        }
+        return expr;
+    }
+    foldEach(cdr(expr));
+    if (head == ifSymbol && length(expr) == 4) {
+        Value *test = knownValue(car(cdr(expr)));
+        if (test->type == BOOL_TYPE) {
+            Value *branch = test->i ? car(cdr(cdr(expr))) : car(cdr(cdr(cdr(expr))));
+            return isFolded(car(cdr(expr))) ? guard(branch, expr) : branch;
+        }
+    }
+    return expr;
+}
+
+Value *fold(Value *expr, Frame *top) {
+    if (!folding) {
+        return expr;
+    }
+    topLevel = top;
+    version = primitivesVersion;
+    for (size_t i = 0; i < FOLDABLES; i++) {
+        if (foldables[i].symbol == NULL) {
+            foldables[i].symbol = intern(foldables[i].name);
+            foldables[i].symbol->sym.foldable = true;
+        }
+    }
+    return foldExpr(expr);
+}
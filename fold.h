@@ -0,0 +1,36 @@
+#include <stdbool.h>
+#include "value.h"
+#include "interpreter.h"
+
+#ifndef _FOLD
+#define _FOLD
+
+// The folding pass, which runs on each top-level expression after resolve
+// (see resolve.h) and before it is evaluated, rewriting it in place:
+//
+// - An application of an arithmetic or comparison primitive to numbers, such
+//   as (* 60 60 24), is replaced by its value, so long as the operator is a
+//   global that still holds the primitive bind gave it, and the primitive
+//   wouldn't raise an error.
+// - An if whose test is #t or #f is replaced by the branch it would take, and
+//   cond clauses whose tests are #f, or that follow a clause whose test is #t
+//   or else, are dropped.
+// - A let variable bound to a constant and never assigned is replaced by the
+//   constant everywhere it is used, other than as an operator. If that leaves
+//   the let with no variables, the let is replaced by its body, and doesn't
+//   create a frame at all.
+//
+// Folding an application, or pruning a branch on a test that was folded,
+// assumes the operators are still bound to the primitives they are bound to
+// now. So the result is put in a (folded <version> replacement original)
+// form, with the current primitivesVersion (see globals.h), and the original
+// expression is evaluated instead once the global of one of the operators
+// that can be folded has been given another value. Folding never changes what a program prints.
+
+extern bool folding;
+
+// Folds a resolved top-level expression, with operators looked up in the
+// top-level frame, and returns what should replace it
+Value *fold(Value *expr, Frame *top);
+
+#endif
@@ -0,0 +1,84 @@
+// globals.c
+
+// The top-level environment. Names are interned, so they are hashed and
+// compared by address.
+
+#include <string.h>
+#include "value.h"
+#include "linkedlist.h"
+#include "talloc.h"
+#include "globals.h"
+#include "profile.h"
+
+uint32_t globalsVersion = 0;
+uint32_t primitivesVersion = 0;
+
+// Fibonacci hash of a symbol's address. Values are allocated on 8-byte
+// boundaries, so the low bits alone would crowd into a few slots.
+static size_t hashName(Value *name) {
+    return (size_t) (((uintptr_t) name >> 3) * 11400714819323198485ull >> 32);
+}
+
+// Returns the slot holding the global with the given name, or the empty slot
+// where it belongs
+static Value **findSlot(Globals *globals, Value *name) {
+    size_t index = hashName(name) & (globals->capacity - 1);
+    while (globals->pairs[index] != NULL && car(globals->pairs[index]) != name) {
+        index = (index + 1) & (globals->capacity - 1);
+    }
+    return &globals->pairs[index];
+}
+
+// Doubles the size of the table, rehashing every global
+static void grow(Globals *globals) {
+    Value **old = globals->pairs;
+    size_t oldCapacity = globals->capacity;
+    globals->capacity *= 2;
+    globals->pairs = talloc(globals->capacity * sizeof(Value *));
+    memset(globals->pairs, 0, globals->capacity * sizeof(Value *));
+    for (size_t i = 0; i < oldCapacity; i++) {
+        if (old[i] != NULL) {
+            *findSlot(globals, car(old[i])) = old[i];
+        }
+    }
+}
+
+Globals *newGlobals() {
+    globalsVersion++;
+    primitivesVersion++;
+    Globals *globals = talloc(sizeof(Globals));
+    globals->capacity = 64;
+    globals->count = 0;
+    globals->pairs = talloc(globals->capacity * sizeof(Value *));
+    memset(globals->pairs, 0, globals->capacity * sizeof(Value *));
+    return globals;
+}
+
+Value *findGlobal(Globals *globals, Value *name) {
+    return *findSlot(globals, name);
+}
+
+void defineGlobal(Globals *globals, Value *name, Value *value) {
+    if (profiling && (value->type == CLOSURE_TYPE || value->type == PRIMITIVE_TYPE)) {
+        nameProcedure(value, name->s);
+    }
+    if (2 * (globals->count + 1) > globals->capacity) {
+        grow(globals);
+    }
+    Value **slot = findSlot(globals, name);
+    if (*slot != NULL) {
+        setGlobal(*slot, value);
+        return;
+    }
+    *slot = cons(name, cons(value, makeEmptyList()));
+    globals->count++;
+    globalsVersion++;
+}
+
+void setGlobal(Value *pair, Value *value) {
+    Value *old = car(cdr(pair));
+    if (car(pair)->sym.foldable && old->type == PRIMITIVE_TYPE && old != value) {
+        primitivesVersion++;
+    }
+    cdr(pair)->c.car = value;
+}
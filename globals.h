@@ -0,0 +1,41 @@
+#include "value.h"
+
+#ifndef _GLOBALS
+#define _GLOBALS
+
+// The variables defined at top level, and the primitives. Each global is a
+// (name value) list, kept in an open addressing hash table keyed by the
+// interned name, so lookup, define and set! take the same time however many
+// globals there are.
+typedef struct Globals {
+    Value **pairs;
+    size_t capacity;
+    size_t count;
+} Globals;
+
+// Bumped whenever a global is added or a table is made. A global stays in the
+// same (name value) list once it is defined: define and set! only change the
+// value in it. So a reference can keep the list it found, and trust it for
+// as long as globalsVersion hasn't changed, rather than look the name up
+// again (see findPair). There is only one table in use at a time.
+extern uint32_t globalsVersion;
+
+// Bumped whenever a global holding one of the primitives the folding pass
+// folds, such as +, is given another value, or a table is made. Code folded on the assumption that the primitives are still
+// bound where they were (see fold.h) is only used while this hasn't changed.
+extern uint32_t primitivesVersion;
+
+// Makes an empty table of globals
+Globals *newGlobals();
+
+// Returns the (name value) list of the global with the given interned name, or
+// NULL if it hasn't been defined
+Value *findGlobal(Globals *globals, Value *name);
+
+// Defines a global, or redefines it if it already exists
+void defineGlobal(Globals *globals, Value *name, Value *value);
+
+// Sets the value in a global's (name value) list, as set! does
+void setGlobal(Value *pair, Value *value);
+
+#endif
@@ -0,0 +1,316 @@
+// hash.c
+
+// Hash tables, and the equal? and eq? they compare keys with. Keys are hashed
+// according to the same rules they are compared by, so keys that are equal?
+// always hash alike. Lists and vectors are hashed by their first few
+// elements only, so a long list costs no more to hash than a short one.
+
+#include <string.h>
+#include "value.h"
+#include "linkedlist.h"
+#include "talloc.h"
+#include "interpreter.h"
+#include "hash.h"
+
+#define INITIAL_CAPACITY 8
+
+// How many elements of nested lists and vectors go into a key's hash
+#define HASH_BUDGET 32
+
+// Scrambles the bits of a word, so that nearby values land far apart
+static uint64_t mix(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ull;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+// The bits of a double, so that doubles compare and hash like eqv?: -0.0 is
+// not 0.0, and a NaN is the same as itself
+static uint64_t doubleBits(double d) {
+    uint64_t bits;
+    memcpy(&bits, &d, sizeof(bits));
+    return bits;
+}
+
+bool valuesEq(Value *a, Value *b) {
+    return a == b || (a->type == INT_TYPE && b->type == INT_TYPE && a->i == b->i);
+}
+
+bool valuesEqual(Value *a, Value *b) {
+    while (a != b) {
+        if (a->type != b->type) {
+            return false;
+        }
+        switch (a->type) {
+            case INT_TYPE:
+            case BOOL_TYPE:
+                return a->i == b->i;
+            case DOUBLE_TYPE:
+                return doubleBits(a->d) == doubleBits(b->d);
+            case STR_TYPE:
+                return strcmp(a->s, b->s) == 0;
+            case NULL_TYPE:
+            case VOID_TYPE:
+                return true;
+            case VECTOR_TYPE:
+                if (a->vec.size != b->vec.size) {
+                    return false;
+                }
+                for (int64_t i = 0; i < a->vec.size; i++) {
+                    if (!valuesEqual(a->vec.items[i], b->vec.items[i])) {
+                        return false;
+                    }
+                }
+                return true;
+            case CONS_TYPE:
+                if (!valuesEqual(a->c.car, b->c.car)) {
+                    return false;
+                }
+                a = a->c.cdr;
+                b = b->c.cdr;
+                break;
+            default:
+                // Symbols are interned, and procedures and tables are only
+                // equal to themselves
+                return false;
+        }
+    }
+    return true;
+}
+
+// Hashes a key of a make-hash table, spending at most *budget elements of
+// lists and vectors
+static uint64_t hashEqual(Value *value, int *budget) {
+    switch (value->type) {
+        case INT_TYPE:
+        case BOOL_TYPE:
+            return mix(value->i ^ ((uint64_t) value->type << 56));
+        case DOUBLE_TYPE:
+            return mix(doubleBits(value->d) ^ ((uint64_t) DOUBLE_TYPE << 56));
+        case STR_TYPE: {
+            // FNV-1a
+            uint64_t hash = 14695981039346656037ull;
+            for (char *c = value->s; *c != '\0'; c++) {
+                hash = (hash ^ (unsigned char) *c) * 1099511628211ull;
+            }
+            return hash;
+        }
+        case NULL_TYPE:
+        case VOID_TYPE:
+            return mix(value->type);
+        case CONS_TYPE: {
+            uint64_t hash = mix(CONS_TYPE);
+            while (value->type == CONS_TYPE && *budget > 0) {
+                (*budget)--;
+                hash = mix(hash ^ hashEqual(value->c.car, budget));
+                value = value->c.cdr;
+            }
+            return hash;
+        }
+        case VECTOR_TYPE: {
+            uint64_t hash = mix(VECTOR_TYPE ^ value->vec.size);
+            for (int64_t i = 0; i < value->vec.size && *budget > 0; i++) {
+                (*budget)--;
+                hash = mix(hash ^ hashEqual(value->vec.items[i], budget));
+            }
+            return hash;
+        }
+        default:
+            return mix((uintptr_t) value);
+    }
+}
+
+// Hashes a key the way the table compares keys
+static uint64_t hashKey(HashTable *table, Value *key) {
+    if (table->equal) {
+        int budget = HASH_BUDGET;
+        return hashEqual(key, &budget);
+    }
+    if (key->type == INT_TYPE) {
+        return mix(key->i);
+    }
+    return mix((uintptr_t) key);
+}
+
+// Returns the index of the entry for the key, or of the empty entry where it
+// belongs
+static size_t findEntry(HashTable *table, Value *key, uint64_t hash) {
+    size_t mask = table->capacity - 1;
+    size_t index = hash & mask;
+    while (true) {
+        HashEntry *entry = &table->entries[index];
+        if (entry->key == NULL) {
+            return index;
+        }
+        if (entry->hash == hash
+                && (table->equal ? valuesEqual(entry->key, key) : valuesEq(entry->key, key))) {
+            return index;
+        }
+        index = (index + 1) & mask;
+    }
+}
+
+// Doubles the size of the table, moving every entry
+static void grow(HashTable *table) {
+    HashEntry *old = table->entries;
+    size_t oldCapacity = table->capacity;
+    table->capacity *= 2;
+    table->entries = talloc(table->capacity * sizeof(HashEntry));
+    memset(table->entries, 0, table->capacity * sizeof(HashEntry));
+    for (size_t i = 0; i < oldCapacity; i++) {
+        if (old[i].key != NULL) {
+            size_t index = old[i].hash & (table->capacity - 1);
+            while (table->entries[index].key != NULL) {
+                index = (index + 1) & (table->capacity - 1);
+            }
+            table->entries[index] = old[i];
+        }
+    }
+}
+
+// Removes the entry at the given index, moving later entries in its probe
+// sequence back so none of them is cut off from where it belongs
+static void removeEntry(HashTable *table, size_t index) {
+    size_t mask = table->capacity - 1;
+    size_t next = (index + 1) & mask;
+    while (table->entries[next].key != NULL) {
+        size_t home = table->entries[next].hash & mask;
+        // Move the entry back if its home isn't between the hole and it
+        if (((next - home) & mask) >= ((next - index) & mask)) {
+            table->entries[index] = table->entries[next];
+            index = next;
+        }
+        next = (next + 1) & mask;
+    }
+    table->entries[index] = (HashEntry) {NULL, NULL, 0};
+    table->count--;
+}
+
+static Value *makeHash(Value *args, bool equal) {
+    if (args->type != NULL_TYPE) {
+        evaluationError();
+    }
+    HashTable *table = talloc(sizeof(HashTable));
+    table->capacity = INITIAL_CAPACITY;
+    table->count = 0;
+    table->equal = equal;
+    table->entries = talloc(table->capacity * sizeof(HashEntry));
+    memset(table->entries, 0, table->capacity * sizeof(HashEntry));
+    Value *value = newValue(HASH_TYPE);
+    value->hash = table;
+    return value;
+}
+
+// Returns the table that is the first argument, checking there are between
+// min and max arguments
+static HashTable *tableArgument(Value *args, int min, int max) {
+    int count = length(args);
+    if (count < min || count > max || car(args)->type != HASH_TYPE) {
+        evaluationError();
+    }
+    return car(args)->hash;
+}
+
+Value *primitiveMakeHash(Value *args) {
+    return makeHash(args, true);
+}
+
+Value *primitiveMakeHashEq(Value *args) {
+    return makeHash(args, false);
+}
+
+Value *primitiveIsHash(Value *args) {
+    if (length(args) != 1) {
+        evaluationError();
+    }
+    return makeBool(car(args)->type == HASH_TYPE);
+}
+
+Value *primitiveHashRef(Value *args) {
+    HashTable *table = tableArgument(args, 2, 3);
+    Value *key = car(cdr(args));
+    HashEntry *entry = &table->entries[findEntry(table, key, hashKey(table, key))];
+    if (entry->key != NULL) {
+        return entry->value;
+    }
+    if (cdr(cdr(args))->type == NULL_TYPE) {
+        evaluationError();
+    }
+    return car(cdr(cdr(args)));
+}
+
+Value *primitiveHashSet(Value *args) {
+    HashTable *table = tableArgument(args, 3, 3);
+    Value *key = car(cdr(args));
+    uint64_t hash = hashKey(table, key);
+    HashEntry *entry = &table->entries[findEntry(table, key, hash)];
+    if (entry->key == NULL) {
+        if (2 * (table->count + 1) > table->capacity) {
+            grow(table);
+            entry = &table->entries[findEntry(table, key, hash)];
+        }
+        entry->key = key;
+        entry->hash = hash;
+        table->count++;
+    }
+    entry->value = car(cdr(cdr(args)));
+    return makeVoid();
+}
+
+Value *primitiveHashRemove(Value *args) {
+    HashTable *table = tableArgument(args, 2, 2);
+    Value *key = car(cdr(args));
+    size_t index = findEntry(table, key, hashKey(table, key));
+    if (table->entries[index].key != NULL) {
+        removeEntry(table, index);
+    }
+    return makeVoid();
+}
+
+Value *primitiveHashHasKey(Value *args) {
+    HashTable *table = tableArgument(args, 2, 2);
+    Value *key = car(cdr(args));
+    return makeBool(table->entries[findEntry(table, key, hashKey(table, key))].key != NULL);
+}
+
+Value *primitiveHashCount(Value *args) {
+    return makeInt(tableArgument(args, 1, 1)->count);
+}
+
+// What hashContents lists for each entry
+typedef enum {KEYS, VALUES, PAIRS} contents;
+
+// Lists the keys, values or (key . value) pairs of the table in the first
+// argument
+static Value *hashContents(Value *args, contents what) {
+    HashTable *table = tableArgument(args, 1, 1);
+    Value *list = makeNull();
+    for (size_t i = table->capacity; i > 0; i--) {
+        HashEntry *entry = &table->entries[i - 1];
+        if (entry->key == NULL) {
+            continue;
+        }
+        if (what == KEYS) {
+            list = cons(entry->key, list);
+        } else if (what == VALUES) {
+            list = cons(entry->value, list);
+        } else {
+            list = cons(cons(entry->key, entry->value), list);
+        }
+    }
+    return list;
+}
+
+Value *primitiveHashKeys(Value *args) {
+    return hashContents(args, KEYS);
+}
+
+Value *primitiveHashValues(Value *args) {
+    return hashContents(args, VALUES);
+}
+
+Value *primitiveHashToList(Value *args) {
+    return hashContents(args, PAIRS);
+}
@@ -0,0 +1,72 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "value.h"
+
+#ifndef _HASH
+#define _HASH
+
+// A hash table, the contents of a HASH_TYPE value. Entries are kept in an
+// open addressing table with linear probing, like the globals, along with
+// each key's hash so the table can grow without rehashing keys.
+//
+// A table made by make-hash compares keys with equal?: numbers of the same
+// type and value, strings with the same characters, and lists and vectors
+// with equal elements are the same key. One made by make-hasheq compares
+// them with eq?, so only the very same object, or integers with the same
+// value, are the same key. Symbols are interned, so they work as keys either
+// way.
+typedef struct HashEntry {
+    Value *key;
+    Value *value;
+    uint64_t hash;
+} HashEntry;
+
+struct HashTable {
+    HashEntry *entries;
+    size_t capacity;
+    size_t count;
+    bool equal;
+};
+
+typedef struct HashTable HashTable;
+
+// Returns true if two values are equal?
+bool valuesEqual(Value *a, Value *b);
+
+// Returns true if two values are eq?
+bool valuesEq(Value *a, Value *b);
+
+// The hash table primitives. Each takes its arguments as a list and reports
+// bad arguments with an evaluation error.
+
+// (make-hash) and (make-hasheq): a new, empty table
+Value *primitiveMakeHash(Value *args);
+Value *primitiveMakeHashEq(Value *args);
+
+// (hash? v)
+Value *primitiveIsHash(Value *args);
+
+// (hash-ref table key) or (hash-ref table key default): the value for key,
+// or default if there isn't one. It is an error if there is neither.
+Value *primitiveHashRef(Value *args);
+
+// (hash-set! table key value)
+Value *primitiveHashSet(Value *args);
+
+// (hash-remove! table key)
+Value *primitiveHashRemove(Value *args);
+
+// (hash-has-key? table key)
+Value *primitiveHashHasKey(Value *args);
+
+// (hash-count table): the number of entries
+Value *primitiveHashCount(Value *args);
+
+// (hash-keys table), (hash-values table) and (hash->list table): the keys,
+// the values, or (key . value) pairs, as lists, in the table's order
+Value *primitiveHashKeys(Value *args);
+Value *primitiveHashValues(Value *args);
+Value *primitiveHashToList(Value *args);
+
+#endif
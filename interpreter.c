@@ -8,27 +8,37 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include "tokenizer.h"
 #include "value.h"
 #include "linkedlist.h"
-#include "parser.h"
 #include "talloc.h"
 #include "interpreter.h"
+#include "symbol.h"
+#include "resolve.h"
+#include "globals.h"
+#include "output.h"
+#include "vector.h"
+#include "hash.h"
+#include "lists.h"
+#include "profile.h"
+#include "stats.h"
+#include "trace.h"
+#include "fold.h"
 
 // Declaration of methods that are not in the header file interpreter.h
 void printValue(Value* value);
 Value* lookUpSymbol(Value* tree, Frame* frame);
 Value* findPair(Value* tree, Frame* frame);
 void evaluationError();
-void printTree_2(Value* value);
-Value* evalBegin(Value* args, Frame* frame);
-Value* evalIf(Value* args, Frame* frame);
-Value* evalCond(Value* args, Frame* frame);
-Value* evalLet(Value* args, Frame* frame);
-Value* evalLetRec(Value* args, Frame* frame);
-Value* evalLetStar(Value* args, Frame* frame);
+Value* evalBegin(Value* args, Frame** frame);
+Value* evalFolded(Value* args, Frame** frame);
+Value* evalIf(Value* args, Frame** frame);
+Value* evalCond(Value* args, Frame** frame);
+Value* evalLet(Value* args, Frame** frame);
+Value* evalLetRec(Value* args, Frame** frame);
+Value* evalLetStar(Value* args, Frame** frame);
 Value* evalSetBang(Value* args, Frame* frame);
 Value* apply(Value *function, Value *args);
+Frame* bindArguments(Value* function, Value* args);
 Value* evalQuote(Value* args,Frame* frame);
 Value* evalLambda(Value* args, Frame* frame);
 Value* evalDefine(Value* args, Frame* frame);
@@ -36,8 +46,14 @@ Value* evalEach(Value* args,Frame* frame);
 
 
 // Evaluates an 'if' statement, and does error checking to make sure
-// the input is valid
-Value* evalIf(Value* args, Frame* frame) {
+// the input is valid. The branch taken is in tail position, so rather than
+// evaluating it, evalIf returns it for eval to carry on with.
+//
+// evalIf, evalCond, evalBegin and the lets are the special forms with a tail
+// position. Each returns the expression eval should continue with, and
+// updates *frame to the frame it should be evaluated in. If the form has
+// already produced its value instead, it sets *frame to NULL and returns it.
+Value* evalIf(Value* args, Frame** frame) {
     //Checks if there are 3 things in args 
     int count = 0;
     Value* current = args;
@@ -52,7 +68,7 @@ Value* evalIf(Value* args, Frame* frame) {
     
     //Checks if the first thing in args is a BOOL_TYPE
     
-    Value* first = eval(eval(car(args),frame),frame);
+    Value* first = eval(eval(car(args),*frame),*frame);
     
     //printValue(first);printf("\n");
     if ( first->type != BOOL_TYPE ){
@@ -62,24 +78,24 @@ Value* evalIf(Value* args, Frame* frame) {
     //Evaluating "if"
     if (first->i == 1){
         //printf("If -Evaluating true\n");
-        return eval( car(cdr(args)), frame);
+        return car(cdr(args));
     } else {
         //printf("If -Evaluating false\n");
-        return eval( car(cdr(cdr(args))),frame );
+        return car(cdr(cdr(args)));
     }
 
 }
 
 // Evaluates the 'cond' function in racket. Evaluates left to right: if it finds a true, evaluates
 // whatever follows. If no true if found, and an else is found at the rightmost location, evaluates whatever
-// 
-Value* evalCond(Value* args, Frame* frame){
+// follows it. The last expression of the chosen clause is in tail position.
+Value* evalCond(Value* args, Frame** frame){
     Value* current = args;
     while (current->type != NULL_TYPE){
         if(current->type == CONS_TYPE ){
             Value* first = car(car(current));
-            if (first->type == SYMBOL_TYPE){
-                if(!strcmp(first->s, "else")){
+            if (first->type == SYMBOL_TYPE || first->type == LOCAL_TYPE){
+                if(first == elseSymbol){
                     if(cdr(current)->type == NULL_TYPE) {
                         return evalBegin(cdr(car(current)), frame);
                     }
@@ -88,8 +104,8 @@ Value* evalCond(Value* args, Frame* frame){
                         evaluationError();
                     }
                 }
-                else if(lookUpSymbol(first,frame)->type == BOOL_TYPE){
-                    if(lookUpSymbol(first,frame)->i == 1) {
+                else if(eval(first,*frame)->type == BOOL_TYPE){
+                    if(eval(first,*frame)->i == 1) {
                         return evalBegin(cdr(car(current)), frame);
                     }
                 }else{
@@ -99,7 +115,7 @@ Value* evalCond(Value* args, Frame* frame){
             
            
             else if (first->type == BOOL_TYPE || first->type == CONS_TYPE ){
-                first = eval(car(car(current)),frame);
+                first = eval(car(car(current)),*frame);
                 if (first->i == 1){
                     return evalBegin(cdr(car(current)),frame);
                 }
@@ -111,166 +127,106 @@ Value* evalCond(Value* args, Frame* frame){
         }
         current = cdr(current);
     }
-    Value* voidtype = makeNull();
-    voidtype->type = VOID_TYPE;
-    return voidtype;
+    *frame = NULL;
+    return makeVoid();
     
 }
 
 
-// A helper function that creates a new frame, given a list of bindings and a 
-// parent frame. Also does error checking
-Frame* newFrame(Value* pairs, Frame* frame){
+static size_t frameCount = 0;
 
-    //Creates new frame "on top" of old frame.
-    Frame* new_frame =  talloc(sizeof(Frame));
-    new_frame->bindings = makeNull();
-    new_frame->parent = frame;
-    
-    //Checks if the pairs given is correct format. 
-    //The pairs should be a list of 2-item lists, with the car of each sublist being a SYMBOL_TYPE.
-    
-    Value* current = pairs;
-    while (current->type != NULL_TYPE){
-        Value* pair = car(current);
-        if(pair->type != CONS_TYPE){
-            //printf("Frame-Bindings not a list of pairs\n");
-            evaluationError();
-        }
-        if(car(pair)->type != SYMBOL_TYPE ){
-            //printf("Frame- First thing in pair is not a symbol\n");
-            evaluationError();
-        }
-        if (length(pair) !=  2){
-            //printf("Frame- Things in list are not pairs l\n");
-            evaluationError();
-        }
-        if(cdr(pair)->type == CONS_TYPE) {
-            Value* second = eval(car(cdr(pair)),frame);
-            Value* new_binding = makeNull();
-            new_binding = cons(second,new_binding);
-            new_binding = cons(car(pair), new_binding);
-            new_frame->bindings = cons(new_binding,new_frame->bindings);
-            current = cdr(current); 
-        }
-        else {
-            //printf("Not a cons type.. aborting\n");   
-            evaluationError();
-        }
-    }   
+size_t framesMade(){
+    return frameCount;
+}
+
+// A helper function that creates a new frame with the layout given by a
+// SCOPE_TYPE, on top of the given parent frame. All slots start out unbound.
+Frame* newFrame(Value* scope, Frame* parent){
+    frameCount++;
+    int size = scope->scope.size;
+    if (tracing) {
+        traceEvent(TRACE_FRAME, NULL, size);
+    }
+    Frame* new_frame = talloc(sizeof(Frame) + size * sizeof(Value*));
+    new_frame->globals = NULL;
+    new_frame->parent = parent;
+    new_frame->scope = scope;
+    for (int i = 0; i < size; i++) {
+        new_frame->slots[i] = NULL;
+    }
     return new_frame;
 }
 
-// This function evaluates a 'let' function as defined by the Racket 'let' 
-// function, and returns a Value*. Does error checking
-Value* evalLet(Value* args,Frame* frame){
-    //Checks if there are 2 things in args 
-    int count = 0;
-    Value* current = args;
-    while (current->type != NULL_TYPE){
-        count +=1;
-        current = cdr(current);
+// Returns the address of the slot a LOCAL_TYPE refers to, starting from the
+// given frame
+Value** slotAddress(Value* local, Frame* frame){
+    for (int depth = local->local.depth; depth > 0; depth--) {
+        frame = frame->parent;
     }
-    
-    if(count!=2){
-        //printf("Let-there are not 2 arguments\n");
+    return &frame->slots[local->local.slot];
+}
+
+// Returns the top-level frame, which holds the globals, every variable the
+// resolver left as a symbol
+Frame* topFrame(Frame* frame){
+    while (frame->scope != NULL) {
+        frame = frame->parent;
+    }
+    return frame;
+}
+
+// This function evaluates a 'let' function as defined by the Racket 'let' 
+// function. The shape of the let was checked by the resolver, which only adds
+// a scope to well-formed lets. The body is in tail position.
+Value* evalLet(Value* args,Frame** frame){
+    if(car(args)->type != SCOPE_TYPE){
+        //printf("Let-not a list of pairs followed by a body\n");
         evaluationError();
     }
     
-    //Create new frame with first arg and evaluate second arg
-    Frame* newframe = newFrame( car(args), frame );
-    return eval( car(cdr(args)),newframe );
+    //Create new frame, evaluating each binding in the old frame, and evaluate the body
+    Frame* newframe = newFrame(car(args), *frame);
+    int slot = 0;
+    Value* current = car(cdr(args));
+    while (current->type != NULL_TYPE){
+        newframe->slots[slot] = eval(car(cdr(car(current))), *frame);
+        slot += 1;
+        current = cdr(current);
+    }
+    *frame = newframe;
+    return car(cdr(cdr(args)));
 }
 
-// Evaluates the 'let*' function in racket. Evaluates/binds parameters left to right
-Value* evalLetStar(Value* args, Frame* frame){
-    if (length(args)!= 2){
-        //printf("Let-there are not 2 arguments\n");
+// Creates the frame for a 'let*' or 'letrec', evaluating the bindings left to
+// right in the new frame. The resolver makes sure each binding of a let* can
+// only see the ones before it.
+Frame* bindSequentially(Value* args, Frame* frame){
+    if(car(args)->type != SCOPE_TYPE){
+        //printf("Let-not a list of pairs followed by a body\n");
         evaluationError();
     }
-   
-    Value* pairs = car(args);
-    Value* current = pairs;
+    Frame* newframe = newFrame(car(args), frame);
+    int slot = 0;
+    Value* current = car(cdr(args));
     while (current->type != NULL_TYPE){
-        Value* pair = car(current);
-        if(pair->type != CONS_TYPE){
-            //printf("Frame-Bindings not a list of pairs\n");
-            evaluationError();
-        }
-        if(car(pair)->type != SYMBOL_TYPE ){
-            //printf("Frame- First thing in pair is not a symbol\n");
-            evaluationError();
-        }
-        if (length(pair) !=  2){
-            //printf("Frame- Things in list are not pairs l\n");
-            evaluationError();
-        }
-        if(cdr(pair)->type == CONS_TYPE) {
-            Frame* new_frame =  talloc(sizeof(Frame));
-            new_frame->bindings = makeNull();
-            new_frame->parent = frame;
-            
-            Value* second = eval(car(cdr(pair)),frame);
-            Value* new_binding = makeNull();
-            new_binding = cons(second,new_binding);
-            new_binding = cons(car(pair), new_binding);
-            new_frame->bindings = cons(new_binding,new_frame->bindings);
-            
-            frame = new_frame;
-            current = cdr(current); 
-        }
-        else {
-            //printf("Not a cons type.. aborting\n");   
-            evaluationError();
-        }
-    }   
-    return eval( car(cdr(args)),frame );
-    
+        newframe->slots[slot] = eval(car(cdr(car(current))), newframe);
+        slot += 1;
+        current = cdr(current);
+    }
+    return newframe;
+}
+
+// Evaluates the 'let*' function in racket. Evaluates/binds parameters left to right
+Value* evalLetStar(Value* args, Frame** frame){
+    *frame = bindSequentially(args, *frame);
+    return car(cdr(cdr(args)));
 }
 
 // Evaluates the 'letrec' function in racket. Evaluates the parameters left to right, and makes parameters
 // available as soon as they are binded.
-Value* evalLetRec(Value* args, Frame* frame){
-    if (length(args)!= 2){
-        //printf("Let-there are not 2 arguments\n");
-        evaluationError();
-    }
-   
-    Frame* new_frame =  talloc(sizeof(Frame));
-    new_frame->bindings = makeNull();
-    new_frame->parent = frame;
-    
-    Value* pairs = car(args);
-    Value* current = pairs;
-    while (current->type != NULL_TYPE){
-        Value* pair = car(current);
-        if(pair->type != CONS_TYPE){
-            //printf("Frame-Bindings not a list of pairs\n");
-            evaluationError();
-        }
-        if(car(pair)->type != SYMBOL_TYPE ){
-            //printf("Frame- First thing in pair is not a symbol\n");
-            evaluationError();
-        }
-        if (length(pair) !=  2){
-            //printf("Frame- Things in list are not pairs l\n");
-            evaluationError();
-        }
-        if(cdr(pair)->type == CONS_TYPE) {
-            Value* second = eval(car(cdr(pair)),new_frame);
-            Value* new_binding = makeNull();
-            new_binding = cons(second,new_binding);
-            new_binding = cons(car(pair), new_binding);
-            new_frame->bindings = cons(new_binding,new_frame->bindings);
-            current = cdr(current); 
-        }
-        else {
-            //printf("Not a cons type.. aborting\n");   
-            evaluationError();
-        }
-    }   
-    return eval( car(cdr(args)),new_frame );
-    
+Value* evalLetRec(Value* args, Frame** frame){
+    *frame = bindSequentially(args, *frame);
+    return car(cdr(cdr(args)));
 }
 
 // Evaluates the 'set!' function in racket. Reassigns the parameter to the given value.
@@ -281,18 +237,23 @@ Value* evalSetBang(Value* args, Frame* frame){
         count +=1;
         current = cdr(current);
     }
-    if (car(args)->type != SYMBOL_TYPE){
+    if (car(args)->type != SYMBOL_TYPE && car(args)->type != LOCAL_TYPE){
         //printf("Error -define params are not all symbols\n");
         evaluationError();
     }
     if(count == 2){
-        Value* set = talloc(sizeof(Value));
-        set->type = VOID_TYPE;
+        Value* set = makeVoid();
         Value* second = eval(car(cdr(args)),frame);
         
-        Value* pair = findPair(car(args),frame);
-        Value* cdr = pair->c.cdr;
-        cdr->c.car = second;
+        if (car(args)->type == LOCAL_TYPE){
+            Value** slot = slotAddress(car(args), frame);
+            if (*slot == NULL){
+                evaluationError();
+            }
+            *slot = second;
+        } else {
+            setGlobal(findPair(car(args),frame), second);
+        }
         
         return set;
     }else{
@@ -303,26 +264,30 @@ Value* evalSetBang(Value* args, Frame* frame){
     
 }
 
+// Evaluates (folded <version> replacement original), which the folding pass
+// leaves in place of an expression it has folded. The replacement is only
+// right while the primitives it was folded with are still bound, so once one
+// has been rebound the original expression is evaluated instead.
+Value* evalFolded(Value* args, Frame** frame) {
+    if (car(args)->i == primitivesVersion) {
+        return car(cdr(args));
+    }
+    return car(cdr(cdr(args)));
+}
+
 // Evaluates the 'begin' function in racket. Evaluates each of its arguments,
-// and returns the result of the last argument
-Value* evalBegin(Value* args, Frame* frame) {
+// and the last one, whose value is the result, is in tail position
+Value* evalBegin(Value* args, Frame** frame) {
     // The length can be anything greater than or equal to zero, so no error checking needed for that
-    
-    Value* current = evalEach(args,frame);
-    //printValue(args);printf("\n");
-    while(current->type != NULL_TYPE) {
-        if(current->type == CONS_TYPE) {
-            if(cdr(current)->type == NULL_TYPE) {
-                //printf("Got here\n");
-                return car(current);   
-            }
-        }
-        current = cdr(current);
+    if(args->type != CONS_TYPE) {
+        *frame = NULL;
+        return makeVoid();
+    }
+    while(cdr(args)->type == CONS_TYPE) {
+        eval(car(args), *frame);
+        args = cdr(args);
     }
-    // Something went wrong.
-    Value* voidtype = makeNull();
-    voidtype->type = VOID_TYPE;
-    return voidtype;
+    return car(args);
 }
 
 // Evaluates the quote operator
@@ -342,39 +307,19 @@ Value* evalQuote(Value* tree, Frame* frame){
     }
 }
 
-// Creates a closure type, with a pointer to its frame, the param names, and 
-// the function code, as defined in the racket code.
+// Creates a closure type, with a pointer to its frame, the scope describing
+// the frame each call creates, and the function code, as defined in the
+// racket code. The resolver has already checked the parameter list.
 Value* evalLambda(Value* args, Frame* frame){
-    int count = 0;
-    Value* current = args;
-    while (current->type != NULL_TYPE){
-        count +=1;
-        current = cdr(current);
-    }
-    Value* params = car(args);
-    while (params->type != NULL_TYPE){
-        if (params->type != CONS_TYPE){
-            //printf("Error -lambda params are not all CONS\n");
-            evaluationError();
-        }
-        else {
-            if (car(params)->type != SYMBOL_TYPE) {
-                //printf("Error not a symbol\n");
-                evaluationError();
-            }
-        }
-        params = cdr(params);
-    }
-    if(count == 2){
+    if(car(args)->type == SCOPE_TYPE){
         
-        Value* closure = talloc(sizeof(Value));
-        closure->type = CLOSURE_TYPE;
+        Value* closure = newValue(CLOSURE_TYPE);
         closure->cl.frame = frame;
-        closure->cl.paramNames = car(args);
-        closure->cl.functionCode = car(cdr(args));
+        closure->cl.scope = car(args);
+        closure->cl.functionCode = car(cdr(cdr(args)));
         return closure;
     }else{
-        //printf("Error -lambda does not have 2 arguments\n");
+        //printf("Error -lambda does not have a parameter list and a body\n");
         evaluationError();
         return args;
     }
@@ -382,8 +327,8 @@ Value* evalLambda(Value* args, Frame* frame){
 }
 
 // Evaluates the define operator, which will return a Value* of type void.
-// Updates the frame so there is a new binding, appended onto the current list of
-// bindings in the frame
+// A define inside a lambda or let body fills the slot the resolver gave it;
+// anywhere else it defines a global
 Value* evalDefine(Value* args, Frame* frame){
     int count = 0;
     Value* current = args;
@@ -391,19 +336,18 @@ Value* evalDefine(Value* args, Frame* frame){
         count +=1;
         current = cdr(current);
     }
-    if (car(args)->type != SYMBOL_TYPE){
+    if (car(args)->type != SYMBOL_TYPE && car(args)->type != LOCAL_TYPE){
         //printf("Error -define params are not all symbols\n");
         evaluationError();
     }
     if(count == 2){
-        Value* define = talloc(sizeof(Value));
-        define->type = VOID_TYPE;
+        Value* define = makeVoid();
         Value* second = eval(car(cdr(args)),frame);
-        Value* new_binding = makeNull();
-        new_binding = cons(second,new_binding);
-        new_binding = cons(car(args), new_binding);
-        
-        frame->bindings = cons(new_binding,frame->bindings);
+        if (car(args)->type == LOCAL_TYPE){
+            *slotAddress(car(args), frame) = second;
+            return define;
+        }
+        defineGlobal(topFrame(frame)->globals, car(args), second);
         return define;
     }else{
         //printf("Error -define does not have 2 arguments\n");
@@ -418,7 +362,7 @@ Value* evalDefine(Value* args, Frame* frame){
 // of these evaluated items. From here, we reverse the list (it is initially a "stack")
 // and then return it
 Value* evalEach(Value* args,Frame* frame){
-    Value* list = makeNull();
+    Value* list = makeEmptyList();
     while (args->type != NULL_TYPE){
         if(args->type == CONS_TYPE) {
             Value* item = eval(car(args),frame);
@@ -439,95 +383,120 @@ Value* evalEach(Value* args,Frame* frame){
     
 }
 
+// Creates the frame for a call to a closure, with its parameters bound to
+// the arguments
+Frame* bindArguments(Value* function, Value* args){
+    Value* scope = function->cl.scope;
+    Frame* newframe = newFrame(scope, function->cl.frame);
+    int slot = 0;
+    while(args->type != NULL_TYPE){
+        if(slot == scope->scope.params){
+            //printf("Error -number of args and number of params don't match\n");
+            evaluationError();
+        }
+        newframe->slots[slot] = car(args);
+        slot += 1;
+        args = cdr(args);
+    }
+    if (slot != scope->scope.params) {
+        //printf(" ELSE Error -number of args and number of params don't match\n");
+        evaluationError();
+    }
+    return newframe;
+}
+
 // Applys the  given function to the arguments, and returns the
 // evaluation
 Value* apply(Value* function, Value* args){
-    Frame* curr_frame = function->cl.frame;
-    Value* pairs = makeNull();
-    Value* params = function->cl.paramNames;
     if(function->type != CLOSURE_TYPE && function->type != PRIMITIVE_TYPE){
         //printf("Error -apply does not have a closure/function\n");
         evaluationError();
     }
     
     if (function->type == CLOSURE_TYPE){
-        while(args->type != NULL_TYPE){
-            if(params->type == NULL_TYPE){
-                //printf("Error -number of args and number of params don't match\n");
-                evaluationError();
-            }
-
-            Value* new_binding = makeNull();
-            new_binding = cons(car(args), new_binding);
-            new_binding = cons(car(params),new_binding);
-
-            pairs = cons(new_binding,pairs);
-            
-            args = cdr(args);
-            params = cdr(params);
-        }
-        if (args->type == NULL_TYPE && params->type == NULL_TYPE) {
-            Frame* newframe = newFrame(pairs,curr_frame);
-            return eval(function->cl.functionCode, newframe); 
-        }else{
-            //printf(" ELSE Error -number of args and number of params don't match\n");
-            evaluationError();
-            return function;
-        }
+        return eval(function->cl.functionCode, bindArguments(function, args));
     } else if (function->type == PRIMITIVE_TYPE){
-        Frame* newframe = newFrame(pairs,curr_frame);
+        if (profiling) {
+            return profilePrimitive(function, args);
+        }
         Value* result = function->pf(args);
         return result;  
     }
     return args;
 }
 
-// This function returns the Value* assocated with a given symbol and frame. Will
-// look to the parent frame if the symbol is not found within the current frame, and 
-// does error checking.i
-Value* lookUpSymbol(Value* tree, Frame* frame){
-    char* string = tree->s;
-    Value* binding_list = frame->bindings;
-    if (frame->parent == NULL){
-        //printf("LookupSymbol-Symbol not found:"); printValue(tree);printf("\n");
-        evaluationError();
+// Runs the body of a closure with eval
+static Value *callWithEval(Value *closure, Frame *frame) {
+    return eval(closure->cl.functionCode, frame);
+}
+
+Engine treeWalker = {eval, callWithEval};
+
+// The engine interpret is running, which applyProcedure calls closures with
+static Engine *runningEngine = &treeWalker;
+
+Value *applyProcedure(Value *function, Value *args) {
+    if (tracing) {
+        traceEvent(function->type == CLOSURE_TYPE ? TRACE_CLOSURE : TRACE_PRIMITIVE, NULL, 0);
     }
-    
-    while(binding_list->type != NULL_TYPE) {
-        Value* pair = car(binding_list);
-        
-        if(!strcmp(string, car(pair)->s)) {
-            return car(cdr(pair));
+    if (function->type == CLOSURE_TYPE) {
+        if (profiling) {
+            int base = profileDepth();
+            profileEnter(function);
+            Value *value = runningEngine->call(function, bindArguments(function, args));
+            profileUnwind(base);
+            return value;
         }
-        binding_list = cdr(binding_list);
+        return runningEngine->call(function, bindArguments(function, args));
+    }
+    if (function->type != PRIMITIVE_TYPE) {
+        evaluationError();
     }
-    return lookUpSymbol(tree, frame->parent);
+    if (profiling) {
+        return profilePrimitive(function, args);
+    }
+    return function->pf(args);
+}
+
+// This function returns the Value* assocated with a given symbol in the
+// top-level frame, and does error checking. Local variables never get here:
+// the resolver turns every reference to one into a LOCAL_TYPE.
+Value* lookUpSymbol(Value* tree, Frame* frame){
+    return findPair(tree, frame)->c.cdr->c.car;
 }
 
+// Returns the (name value) binding for a symbol in the top-level frame. The
+// binding found is cached on the symbol, which every reference to the global
+// shares, so after the first lookup the reference doesn't walk up to the
+// top-level frame or hash the name until another global is defined.
 Value* findPair(Value* tree, Frame* frame){
-    char* string = tree->s;
-    Value* binding_list = frame->bindings;
+    if (tree->sym.version == globalsVersion) {
+        return tree->sym.pair;
+    }
+    frame = topFrame(frame);
     if (frame->parent == NULL){
         //printf("LookupSymbol-Symbol not found:"); printValue(tree);printf("\n");
         evaluationError();
     }
-    
-    while(binding_list->type != NULL_TYPE) {
-        Value* pair = car(binding_list);
-        
-        if(!strcmp(string, car(pair)->s)) {
-            return pair;
-        }
-        binding_list = cdr(binding_list);
+    Value* pair = findGlobal(frame->globals, tree);
+    if (pair != NULL) {
+        tree->sym.pair = pair;
+        tree->sym.version = globalsVersion;
+        return pair;
     }
-    return findPair(tree, frame->parent);
+    //printf("LookupSymbol-Symbol not found:"); printValue(tree);printf("\n");
+    evaluationError();
+    return tree;
 }
 
 
 // This function executes if an error occurs in the interpreting, for any number of 
 // reasons.
 void evaluationError(){
-    printf("evaluation error\n");
+    if (tracing) {
+        dumpTrace();
+    }
+    writeText("evaluation error\n");
     texit(1);
 }
 
@@ -557,10 +526,7 @@ Value* evalAnd(Value* args,Frame* frame) {
         else {
             evaluationError();   
         }
-        Value* returnValue = makeNull();
-        returnValue->type = BOOL_TYPE;
-        returnValue->i = boolean;
-        return returnValue;
+        return makeBool(boolean);
     }
 }
 
@@ -590,263 +556,105 @@ Value* evalOr(Value* args,Frame* frame) {
         else {
             evaluationError();   
         }
-        Value* returnValue = makeNull();
-        returnValue->type = BOOL_TYPE;
-        returnValue->i = boolean;
-        return returnValue;
+        return makeBool(boolean);
     }
 }
 
-// Evaluates the '>=' function in racket. Returns true if the first argument is larger than or
-// equal to the second argument (numerically), and returns false otherwise
-Value* primitiveGreaterThanEqualTo(Value* args) {
+// The numeric comparisons
+typedef enum {LESS, LESS_EQUAL, EQUAL, GREATER_EQUAL, GREATER} comparison;
+
+// Returns the value of an INT_TYPE or DOUBLE_TYPE as a double, and raises an
+// error for anything else
+double numberValue(Value* number) {
+    if(number->type == INT_TYPE) {
+        return number->i;
+    }
+    else if(number->type == DOUBLE_TYPE) {
+        return number->d;
+    }
+    evaluationError();
+    return 0;
+}
+
+// Compares two numbers. Two integers are compared exactly; otherwise both are
+// compared as doubles, and any comparison with NaN is false.
+Value* compareNumbers(Value* args, comparison test) {
     if(length(args) != 2) {
         evaluationError();
-        return makeNull();
+    }
+    Value* first = car(args);
+    Value* second = car(cdr(args));
+    int order;
+    if(first->type == INT_TYPE && second->type == INT_TYPE) {
+        order = (first->i > second->i) - (first->i < second->i);
     }
     else {
-        double num1 = 0;
-        double num2;
-        if(args->type == CONS_TYPE) {
-            if(car(args)->type == INT_TYPE) {
-                num1 = car(args)->i;
-            }
-            else if(car(args)->type == DOUBLE_TYPE) {
-                num1 = car(args)->d;
-            }
-            else {
-                evaluationError();   
-            }
-            num2 = 0;
-            if(car(cdr(args))->type == INT_TYPE) {
-                num2 = car(cdr(args))->i;
-            }
-            else if(car(cdr(args))->type == DOUBLE_TYPE) {
-                num2 = car(cdr(args))->d;
-            }
-            else {
-                evaluationError();   
-            }
-        }
-        else {
-            evaluationError();   
-        }
-        
-        Value* returnValue = makeNull();
-        returnValue->type = BOOL_TYPE;
-        if(num1 >= num2) {
-            returnValue->i = 1;   
-        }
-        else {
-            returnValue->i = 0;  
-        }
-        return returnValue;
+        double num1 = numberValue(first);
+        double num2 = numberValue(second);
+        if(num1 != num1 || num2 != num2) {
+            return makeBool(false);
+        }
+        order = (num1 > num2) - (num1 < num2);
+    }
+    switch(test) {
+        case LESS:
+            return makeBool(order < 0);
+        case LESS_EQUAL:
+            return makeBool(order <= 0);
+        case EQUAL:
+            return makeBool(order == 0);
+        case GREATER_EQUAL:
+            return makeBool(order >= 0);
+        default:
+            return makeBool(order > 0);
     }
 }
 
+// Evaluates the '>=' function in racket. Returns true if the first argument is larger than or
+// equal to the second argument (numerically), and returns false otherwise
+Value* primitiveGreaterThanEqualTo(Value* args) {
+    return compareNumbers(args, GREATER_EQUAL);
+}
+
 // Evaluates the '<=' function in racket. Returns true if the first argument is smaller than or
 // equal to the second argument (numerically), and returns false otherwise
 Value* primitiveLessThanEqualTo(Value* args) {
-    if(length(args) != 2) {
-        evaluationError();
-        return makeNull();
-    }
-    else {
-        double num1 = 0;
-        double num2;
-        if(args->type == CONS_TYPE) {
-            if(car(args)->type == INT_TYPE) {
-                num1 = car(args)->i;
-            }
-            else if(car(args)->type == DOUBLE_TYPE) {
-                num1 = car(args)->d;
-            }
-            else {
-                evaluationError();   
-            }
-            num2 = 0;
-            if(car(cdr(args))->type == INT_TYPE) {
-                num2 = car(cdr(args))->i;
-            }
-            else if(car(cdr(args))->type == DOUBLE_TYPE) {
-                num2 = car(cdr(args))->d;
-            }
-            else {
-                evaluationError();   
-            }
-        }
-        else {
-            evaluationError();   
-        }
-        
-        Value* returnValue = makeNull();
-        returnValue->type = BOOL_TYPE;
-        if(num1 <= num2) {
-            returnValue->i = 1;   
-        }
-        else {
-            returnValue->i = 0;  
-        }
-        return returnValue;
-    }
+    return compareNumbers(args, LESS_EQUAL);
 }
 
 // Evaluates the '=' function in racket. Returns true if the first argument is 
 // equal to the second argument (numerically), and returns false otherwise
 Value* primitiveEqualTo(Value* args) {
-    if(length(args) != 2) {
-        evaluationError();
-        return makeNull();
-    }
-    else {
-        double num1 = 0;
-        double num2;
-        if(args->type == CONS_TYPE) {
-            if(car(args)->type == INT_TYPE) {
-                num1 = car(args)->i;
-            }
-            else if(car(args)->type == DOUBLE_TYPE) {
-                num1 = car(args)->d;
-            }
-            else {
-                evaluationError();   
-            }
-            num2 = 0;
-            if(car(cdr(args))->type == INT_TYPE) {
-                num2 = car(cdr(args))->i;
-            }
-            else if(car(cdr(args))->type == DOUBLE_TYPE) {
-                num2 = car(cdr(args))->d;
-            }
-            else {
-                evaluationError();   
-            }
-        }
-        else {
-            evaluationError();   
-        }
-        
-        Value* returnValue = makeNull();
-        returnValue->type = BOOL_TYPE;
-        if(num1 == num2) {
-            returnValue->i = 1;   
-        }
-        else {
-            returnValue->i = 0;  
-        }
-        return returnValue;
-    }
+    return compareNumbers(args, EQUAL);
 }
 
 // Evaluates the '<' function in racket. Returns true if the first argument is smaller than 
 // the second argument (numerically), and returns false otherwise
 Value* primitiveLessThan(Value* args) {
-    if(length(args) != 2) {
-        evaluationError();
-        return makeNull();
-    }
-    else {
-        double num1 = 0;
-        double num2;
-        if(args->type == CONS_TYPE) {
-            if(car(args)->type == INT_TYPE) {
-                num1 = car(args)->i;
-            }
-            else if(car(args)->type == DOUBLE_TYPE) {
-                num1 = car(args)->d;
-            }
-            else {
-                evaluationError();   
-            }
-            num2 = 0;
-            if(car(cdr(args))->type == INT_TYPE) {
-                num2 = car(cdr(args))->i;
-            }
-            else if(car(cdr(args))->type == DOUBLE_TYPE) {
-                num2 = car(cdr(args))->d;
-            }
-            else {
-                evaluationError();   
-            }
-        }
-        else {
-            evaluationError();   
-        }
-        
-        Value* returnValue = makeNull();
-        returnValue->type = BOOL_TYPE;
-        if(num1 < num2) {
-            returnValue->i = 1;   
-        }
-        else {
-            returnValue->i = 0;  
-        }
-        return returnValue;
-    }
+    return compareNumbers(args, LESS);
 }
 
 // Evaluates the '>' function in racket. Returns true if the first argument is larger than 
 // the second argument (numerically), and returns false otherwise
 Value* primitiveGreaterThan(Value* args) {
-    if(length(args) != 2) {
-        evaluationError();
-        return makeNull();
-    }
-    else {
-        double num1 = 0;
-        double num2;
-        if(args->type == CONS_TYPE) {
-            if(car(args)->type == INT_TYPE) {
-                num1 = car(args)->i;
-            }
-            else if(car(args)->type == DOUBLE_TYPE) {
-                num1 = car(args)->d;
-            }
-            else {
-                evaluationError();   
-            }
-            num2 = 0;
-            if(car(cdr(args))->type == INT_TYPE) {
-                num2 = car(cdr(args))->i;
-            }
-            else if(car(cdr(args))->type == DOUBLE_TYPE) {
-                num2 = car(cdr(args))->d;
-            }
-            else {
-                evaluationError();   
-            }
-        }
-        else {
-            evaluationError();   
-        }
-        
-        Value* returnValue = makeNull();
-        returnValue->type = BOOL_TYPE;
-        if(num1 > num2) {
-            returnValue->i = 1;   
-        }
-        else {
-            returnValue->i = 0;  
-        }
-        return returnValue;
-    }
+    return compareNumbers(args, GREATER);
 }
 
 // Implements modulo in Racket, returning errors if there is bad input.
-// Works with both INT_TYPE and DOUBLE_TYPE, but will always return a DOUBLE_TYPE Value*.
+// Only works with INT_TYPE, and returns an INT_TYPE Value*.
 Value* primitiveModulo(Value* args) {
     if(length(args) != 2) {
         evaluationError();
         return makeNull();
     }
     else {
-        int modulo = 0;
+        int64_t modulo = 0;
         int negative1 = 0;
         int negative2 = 0;
         if(args->type == CONS_TYPE) {
             if(car(args)->type == INT_TYPE) {
-                int num1 = car(args)->i;
-                int num2 = 0;
+                int64_t num1 = car(args)->i;
+                int64_t num2 = 0;
                 if(num1 < 0) {
                     negative1 = 1;   
                 }
@@ -859,22 +667,25 @@ Value* primitiveModulo(Value* args) {
                 else {
                     evaluationError();   
                 }
+                if(num2 == 0 || (num2 == -1 && num1 == INT64_MIN)) {
+                    evaluationError();
+                }
                 
                 // Check to see which nums are negative
                 if(negative1 == 1) {
                     if(negative2 == 1) {
-                        modulo = 0 - div(num1, num2).rem;
+                        modulo = 0 - num1 % num2;
                     }
                     else {
-                        modulo = num2 - div(num1, num2).rem;
+                        modulo = num2 - num1 % num2;
                     }
                 }
                 else {
                     if(negative2 == 1) {
-                        modulo = 0 - (abs(num2) - div(num1, num2).rem);
+                        modulo = 0 - (llabs(num2) - num1 % num2);
                     }
                     else {
-                        modulo = div(num1,num2).rem;
+                        modulo = num1 % num2;
                     }
                 }
             }
@@ -886,208 +697,118 @@ Value* primitiveModulo(Value* args) {
             //printf("Not a type\n");
             evaluationError();
         }
-        Value* returnValue = makeNull();
-        returnValue->type = INT_TYPE;
-        returnValue->i = modulo;
-        return returnValue;
+        return makeInt(modulo);
     }
 }
 
 // Implements division in Racket, returning errors if there is bad input.
-// Works with both INT_TYPE and DOUBLE_TYPE, but will always return a DOUBLE_TYPE Value*.
+// Dividing an INT_TYPE exactly by another gives an INT_TYPE; otherwise the
+// result is a DOUBLE_TYPE Value*. Dividing an INT_TYPE by zero is an error.
 Value* primitiveDivide(Value* args) {
     if(length(args) != 2) {
         evaluationError();
         return makeNull();
     }
-    else {
-        double quotient = 0;
-        if(args->type == CONS_TYPE) {
-            if(car(args)->type == INT_TYPE) {
-                double num1 = (double) car(args)->i;
-                double num2 = 0.0;
-                if(car(cdr(args))->type == INT_TYPE) {
-                    num2 = car(cdr(args))->i;
-                }
-                else if(car(cdr(args))->type == DOUBLE_TYPE) {
-                    num2 = car(cdr(args))->d;   
-                }
-                else {
-                    evaluationError();   
-                }
-                quotient = num1 / num2;   
-            }
-            else if (car(args)->type == DOUBLE_TYPE) {
-                double num1 = car(args)->d;
-                double num2 = 0.0;
-                if(car(cdr(args))->type == INT_TYPE) {
-                    num2 = car(cdr(args))->i;
-                }
-                else if(car(cdr(args))->type == DOUBLE_TYPE) {
-                    num2 = car(cdr(args))->d;   
-                }
-                else {
-                    evaluationError();   
-                }
-                quotient = num1 / num2;  
-            }
-            else {
-                evaluationError();
-            }
-        }
-        else {
-            //printf("Not a type\n");
+    Value* first = car(args);
+    Value* second = car(cdr(args));
+    if(first->type == INT_TYPE && second->type == INT_TYPE) {
+        int64_t num1 = first->i;
+        int64_t num2 = second->i;
+        if(num2 == 0 || (num2 == -1 && num1 == INT64_MIN)) {
             evaluationError();
         }
-        Value* returnValue = makeNull();
-        returnValue->type = DOUBLE_TYPE;
-        returnValue->d = quotient;
-        return returnValue;
+        if(num1 % num2 == 0) {
+            return makeInt(num1 / num2);
+        }
+        return makeDouble((double) num1 / num2);
     }
+    return makeDouble(numberValue(first) / numberValue(second));
 }
 
 // Implements subtraction in Racket, returning errors if there is bad input.
-// Works with both INT_TYPE and DOUBLE_TYPE, but will always return a DOUBLE_TYPE Value*.
+// Each argument after the first is subtracted from it, and a single argument
+// is negated. Subtracting INT_TYPEs gives an INT_TYPE, unless it overflows,
+// which is an error. Once a DOUBLE_TYPE is involved, the result is a
+// DOUBLE_TYPE Value*.
 Value *primitiveSubtract(Value* args) {
-    if(length(args) != 2) {
+    if(args->type == NULL_TYPE) {
         evaluationError();
         return makeNull();
     }
-    else {
-        double subtraction = 0;
-        if(args->type == CONS_TYPE) {
-            if(car(args)->type == INT_TYPE) {
-                int num1 = car(args)->i;
-                double num2 = 0.0;
-                if(car(cdr(args))->type == INT_TYPE) {
-                    num2 = car(cdr(args))->i;
-                }
-                else if(car(cdr(args))->type == DOUBLE_TYPE) {
-                    num2 = car(cdr(args))->d;   
-                }
-                else {
-                    evaluationError();   
-                }
-                subtraction = num1 - num2;   
-            }
-            else if (car(args)->type == DOUBLE_TYPE) {
-                double num1 = car(args)->d;
-                double num2 = 0.0;
-                if(car(cdr(args))->type == INT_TYPE) {
-                    num2 = car(cdr(args))->i;
-                }
-                else if(car(cdr(args))->type == DOUBLE_TYPE) {
-                    num2 = car(cdr(args))->d;   
-                }
-                else {
-                    evaluationError();   
-                }
-                subtraction = num1 - num2;  
-            }
-            else {
+    Value* first = car(args);
+    Value* rest = cdr(args);
+    if(rest->type == NULL_TYPE) {
+        first = makeInt(0);
+        rest = args;
+    }
+    double doubleDifference;
+    if(first->type == INT_TYPE) {
+        int64_t difference = first->i;
+        while(rest->type != NULL_TYPE && car(rest)->type == INT_TYPE) {
+            if(__builtin_sub_overflow(difference, car(rest)->i, &difference)) {
                 evaluationError();
             }
+            rest = cdr(rest);
         }
-        else {
-            //printf("Not a type\n");
-            evaluationError();
+        if(rest->type == NULL_TYPE) {
+            return makeInt(difference);
         }
-        Value* returnValue = makeNull();
-        returnValue->type = DOUBLE_TYPE;
-        returnValue->d = subtraction;
-        return returnValue;
+        doubleDifference = difference;
+    } else {
+        doubleDifference = numberValue(first);
+    }
+    while(rest->type != NULL_TYPE) {
+        doubleDifference = doubleDifference - numberValue(car(rest));
+        rest = cdr(rest);
     }
+    return makeDouble(doubleDifference);
 }
 
 // Implements multiplication in Racket, returning errors if there is bad input.
-// Works with both INT_TYPE and DOUBLE_TYPE, but will always return a DOUBLE_TYPE Value*.
+// Multiplying INT_TYPEs gives an INT_TYPE, unless it overflows, which is an
+// error. Once a DOUBLE_TYPE is involved, the result is a DOUBLE_TYPE Value*.
+// The product of no arguments is 1.
 Value *primitiveMult(Value* args) {
-    if(length(args) <= 1) {
-        evaluationError();
-        return makeNull();
-    }
-    else {
-        double product = 1;
-        while (args -> type != NULL_TYPE) {
-            if(args->type == CONS_TYPE) {
-                if(car(args)->type == INT_TYPE) {
-                    product = product * car(args)->i;   
-                }
-                else if (car(args)->type == DOUBLE_TYPE) {
-                    product = product * car(args)->d;   
-                }
-                else {
-                    evaluationError();
-                }
-                args = cdr(args);
-                //}
-            }
-            else {
-                //printf("Not a type\n");
-                evaluationError();
-            }
+    int64_t product = 1;
+    while(args->type != NULL_TYPE && car(args)->type == INT_TYPE) {
+        if(__builtin_mul_overflow(product, car(args)->i, &product)) {
+            evaluationError();
         }
-        Value* returnValue = makeNull();
-        returnValue->type = DOUBLE_TYPE;
-        returnValue->d = product;
-        return returnValue;
+        args = cdr(args);
     }
+    if(args->type == NULL_TYPE) {
+        return makeInt(product);
+    }
+    double doubleProduct = product;
+    while(args->type != NULL_TYPE) {
+        doubleProduct = doubleProduct * numberValue(car(args));
+        args = cdr(args);
+    }
+    return makeDouble(doubleProduct);
 }
 
 // Implements adding in racket, returning errors if there is bad input.
-// Works with both INT_TYPE and DOUBLE_TYPE, but will always return a DOUBLE_TYPE Value*
+// Adding INT_TYPEs gives an INT_TYPE, unless it overflows, which is an error.
+// Once a DOUBLE_TYPE is involved, the result is a DOUBLE_TYPE Value*. The sum
+// of no arguments is 0.
 Value *primitiveAdd(Value *args) {
-    int count = 0;
-    // Set current to be the first value after the '+' operator
-    Value* current = cdr(args);
-    while(current->type != NULL_TYPE) {
-        if(current->type != INT_TYPE && current->type != DOUBLE_TYPE)
-        {
-            count = count + 1;
-            current = cdr(current);
-        }
-        else {
-            //printf("Wrong type of input");
-            evaluationError();   
+    // Stay in exact integers until a DOUBLE_TYPE turns up
+    int64_t sum = 0;
+    while(args->type != NULL_TYPE && car(args)->type == INT_TYPE) {
+        if(__builtin_add_overflow(sum, car(args)->i, &sum)) {
+            evaluationError();
         }
+        args = cdr(args);
     }
-    if (count == 0) {
-        Value* zero = makeNull();
-        zero->type = INT_TYPE;
-        zero->i = 0;
-        return zero;
+    if(args->type == NULL_TYPE) {
+        return makeInt(sum);
     }
-    else { 
-        double sum = 0.0;
-        while (args->type != NULL_TYPE) {
-            if(args->type == CONS_TYPE) {
-                
-                if(car(args)->type == INT_TYPE) {
-                    sum = car(args)->i + sum; 
-                    args = cdr(args);
-                }
-                else if(car(args)->type == DOUBLE_TYPE) {
-                    sum = car(args)->d + sum;
-                    args = cdr(args);
-                }
-                else {
-                    //printf("Bad type\n");
-                    evaluationError();   
-                }
-            }
-            else {
-                //printf("Not a type\n");
-                evaluationError();
-                
-            }
-        }
-        // Evaluate the args one at a time, and apply this to the + function
-        Value* newSum = talloc(sizeof(Value));
-        newSum->type = DOUBLE_TYPE;
-        newSum->d = sum;
-        return newSum;
+    double doubleSum = sum;
+    while(args->type != NULL_TYPE) {
+        doubleSum = numberValue(car(args)) + doubleSum;
+        args = cdr(args);
     }
-    
+    return makeDouble(doubleSum);
 }
 
 // Given a linked list, return a Value* of type CONS_TYPE, with the car being
@@ -1130,45 +851,36 @@ Value *primitiveNull(Value* args) {
         //printf("primitiveNull - not not 1 argument");
         evaluationError();
     }
-    Value* output = makeNull();
-    output->type = BOOL_TYPE;
-    output->i = isNull(car(args));
-    
-    return output;
+    return makeBool(isNull(car(args)));
 }
 
 // Bind a function to a specific sequence of characters
 void bind(char *name, Value *(*function)(struct Value *),Frame *frame) {
-    // Add primitive functions to top-level bindings list
-    Value* value = talloc(sizeof(Value));
-    value->type = PRIMITIVE_TYPE;
+    // Add primitive functions to the top-level globals
+    Value* value = newValue(PRIMITIVE_TYPE);
     value->pf = function;
     
-    // Create a new Value* to hold the "key", being the symbol provided
-    Value* newFunction = talloc(sizeof(Value));
-    newFunction->type = SYMBOL_TYPE;
-    newFunction->s = name;
+    // Look up the "key", being the symbol provided
+    Value* newFunction = intern(name);
     
-    Value* new_binding = makeNull();
-    new_binding = cons(value, new_binding);
-    new_binding = cons(newFunction,new_binding);
-
-    // Cons the key with the value, which is the function
-    frame->bindings = cons(new_binding,frame->bindings);
-
-    // Cons the bindings in the current frame with the newly cons'd function
+    // Define the key as the value, which is the function
+    defineGlobal(frame->globals, newFunction, value);
 }
 
-// Creates a new frame, and runs eval() on the given tree and frame.
-void interpret(Value *tree){
+// Creates the top-level frame, binding every primitive in it
+Frame *newTopFrame(){
+    internSpecialForms();
     
     Frame* frame = talloc(sizeof(Frame));
-    frame->bindings = makeNull();
+    frameCount += 2;
+    frame->globals = NULL;
     frame->parent = NULL;
+    frame->scope = NULL;
     
     Frame* top_frame = talloc(sizeof(Frame));
-    top_frame->bindings = makeNull();
+    top_frame->globals = newGlobals();
     top_frame->parent = frame;
+    top_frame->scope = NULL;
     
     // Creates bindings for all of the primitive types implemented in our interpreter
     bind("+",primitiveAdd,top_frame);
@@ -1185,190 +897,335 @@ void interpret(Value *tree){
     bind("=",primitiveEqualTo,top_frame);
     bind(">=",primitiveGreaterThanEqualTo,top_frame);
     bind("<=",primitiveLessThanEqualTo,top_frame);
-    
-    while (tree->type!= NULL_TYPE){
-        Value* value = eval(car(tree), top_frame);
-        if(value->type != VOID_TYPE){
-            printValue(value);
-            printf("\n");
-        }
-        tree = cdr(tree);
+    bind("list",primitiveList,top_frame);
+    bind("length",primitiveLength,top_frame);
+    bind("append",primitiveAppend,top_frame);
+    bind("reverse",primitiveReverse,top_frame);
+    bind("list-ref",primitiveListRef,top_frame);
+    bind("map",primitiveMap,top_frame);
+    bind("for-each",primitiveForEach,top_frame);
+    bind("filter",primitiveFilter,top_frame);
+    bind("foldl",primitiveFoldl,top_frame);
+    bind("assoc",primitiveAssoc,top_frame);
+    bind("sort",primitiveSort,top_frame);
+    bind("make-vector",primitiveMakeVector,top_frame);
+    bind("vector",primitiveVector,top_frame);
+    bind("vector?",primitiveIsVector,top_frame);
+    bind("vector-length",primitiveVectorLength,top_frame);
+    bind("vector-ref",primitiveVectorRef,top_frame);
+    bind("vector-set!",primitiveVectorSet,top_frame);
+    bind("vector->list",primitiveVectorToList,top_frame);
+    bind("list->vector",primitiveListToVector,top_frame);
+    bind("make-hash",primitiveMakeHash,top_frame);
+    bind("make-hasheq",primitiveMakeHashEq,top_frame);
+    bind("hash?",primitiveIsHash,top_frame);
+    bind("hash-ref",primitiveHashRef,top_frame);
+    bind("hash-set!",primitiveHashSet,top_frame);
+    bind("hash-remove!",primitiveHashRemove,top_frame);
+    bind("hash-has-key?",primitiveHashHasKey,top_frame);
+    bind("hash-count",primitiveHashCount,top_frame);
+    bind("hash-keys",primitiveHashKeys,top_frame);
+    bind("hash-values",primitiveHashValues,top_frame);
+    bind("hash->list",primitiveHashToList,top_frame);
+    bind("memory-stats",primitiveMemoryStats,top_frame);
+    return top_frame;
+}
+
+// Resolves a top-level expression, runs it in the top-level frame with the
+// given engine, and prints its value
+void interpret(Value *expr, Frame *top_frame, Engine *engine){
+    runningEngine = engine;
+    Value* value = engine->run(fold(resolve(expr), top_frame), top_frame);
+    if(value->type != VOID_TYPE){
+        printValue(value);
+        writeLine();
     }
 }
 
-// Given an expression tree and a frame in which to evaluate that expression, eval returns the value of the expression
-Value *eval(Value *tree, Frame *frame) {
-    switch (tree->type) {
-        case INT_TYPE :
-            return tree;
-            break;
-        case STR_TYPE :
-            return tree;
-            break;
-        case BOOL_TYPE :
-            return tree;
-            break;
-        case DOUBLE_TYPE :
-            return tree;
-            break;
-        case CLOSURE_TYPE :
-            return tree;
-            break;
-        case PRIMITIVE_TYPE:
-            return tree;
-            break;
-        case SYMBOL_TYPE :
-            return lookUpSymbol(tree, frame);
-            break;
-        case CONS_TYPE:
-            if(car(tree)->type == SYMBOL_TYPE) {
-                if (!strcmp(car(tree)->s,"if")) {
-                    return evalIf(cdr(tree),frame);
-                }
-                else if(!strcmp(car(tree)->s,"cond")) {
-                    return evalCond(cdr(tree),frame);   
-                }
+// The evaluator for each special form without a tail position, indexed by
+// the form tagged on its symbol
+static Value *(*specialForms[SPECIAL_FORMS])(Value *, Frame *) = {
+    [SET_BANG_FORM] = evalSetBang,
+    // If we encounter a quote symbol we must check to make sure there is only one more argument after
+    // it. If this is not the case, we throw an evaluation error
+    [QUOTE_FORM] = evalQuote,
+    [LAMBDA_FORM] = evalLambda,
+    [DEFINE_FORM] = evalDefine,
+    [AND_FORM] = evalAnd,
+    [OR_FORM] = evalOr,
+};
 
-                else if (!strcmp(car(tree)->s,"let")) {
-                    return evalLet(cdr(tree),frame);
-                }
-                 else if (!strcmp(car(tree)->s,"let*")) {
-                    return evalLetStar(cdr(tree),frame);
-                }else if (!strcmp(car(tree)->s,"letrec")) {
-                    return evalLetRec(cdr(tree),frame);
-                }
-                else if (!strcmp(car(tree)->s,"set!")) {
-                    return evalSetBang(cdr(tree),frame);
-                }
+// The evaluator for each special form with a tail position (see evalIf)
+static Value *(*tailForms[SPECIAL_FORMS])(Value *, Frame **) = {
+    [IF_FORM] = evalIf,
+    [COND_FORM] = evalCond,
+    [LET_FORM] = evalLet,
+    [LET_STAR_FORM] = evalLetStar,
+    [LETREC_FORM] = evalLetRec,
+    [BEGIN_FORM] = evalBegin,
+    [FOLDED_FORM] = evalFolded,
+};
 
-                // If we encounter a quote symbol we must check to make sure there is only one more argument after
-                // it. If this is not the case, we throw an evaluation error
+// The profiler's depth when the innermost eval running started. A closure
+// called by going round eval's loop again replaces any call above it.
+static int evalBase;
 
-                else if (!strcmp(car(tree)->s,"quote") || !strcmp(car(tree)->s,"\'")) {
-                    return evalQuote(cdr(tree),frame);
-                } 
-                else if (!strcmp(car(tree)->s,"lambda")) {
-                    return evalLambda(cdr(tree),frame);
-                }
-                else if(!strcmp(car(tree)->s,"define")) {
-                    return evalDefine(cdr(tree), frame);   
-                }
-                else if(!strcmp(car(tree)->s,"and")) {
-                    return evalAnd(cdr(tree),frame);   
-                }
-                else if(!strcmp(car(tree)->s,"or")) {
-                    return evalOr(cdr(tree),frame);   
+// Given an expression tree and a frame in which to evaluate that expression, walk returns the value of the expression.
+// Expressions in tail position, and the bodies of closures called from them, are evaluated by going round the loop
+// again rather than by a recursive call, so a tail-recursive loop runs in constant stack space.
+static Value *walk(Value *tree, Frame *frame) {
+    while (true) {
+        switch (tree->type) {
+            case INT_TYPE :
+                return tree;
+                break;
+            case STR_TYPE :
+                return tree;
+                break;
+            case BOOL_TYPE :
+                return tree;
+                break;
+            case DOUBLE_TYPE :
+                return tree;
+                break;
+            case CLOSURE_TYPE :
+                return tree;
+                break;
+            case PRIMITIVE_TYPE:
+                return tree;
+                break;
+            case VECTOR_TYPE:
+            case HASH_TYPE:
+                return tree;
+                break;
+            case SYMBOL_TYPE :
+                return lookUpSymbol(tree, frame);
+                break;
+            case LOCAL_TYPE : {
+                Value* value = *slotAddress(tree, frame);
+                if (value == NULL) {
+                    // Used before its define or letrec binding was evaluated
+                    evaluationError();
                 }
-                else if(!strcmp(car(tree)->s,"begin")) {
-                    return evalBegin(cdr(tree),frame);   
+                return value;
+            }
+            case CONS_TYPE: {
+                // Special forms are recognised by the tag on their symbol, so an
+                // ordinary application only pays for this one check
+                Value* head = car(tree);
+                if(head->type == SYMBOL_TYPE && head->sym.form != NO_FORM) {
+                    if (tracing) {
+                        traceEvent(TRACE_FORM, head, head->sym.form);
+                    }
+                    if(tailForms[head->sym.form] == NULL) {
+                        return specialForms[head->sym.form](cdr(tree), frame);
+                    }
+                    tree = tailForms[head->sym.form](cdr(tree), &frame);
+                    if(frame == NULL) {
+                        return tree;
+                    }
+                    continue;
                 }
-                else {
-                    Value *evaledOperator = eval(car(tree), frame);
+                else if(head->type == SYMBOL_TYPE || head->type == LOCAL_TYPE) {
+                    Value *evaledOperator = eval(head, frame);
 
                     Value *evaledArgs = evalEach(cdr(tree), frame);
-                    return apply(evaledOperator,evaledArgs);
+                    if (tracing) {
+                        traceEvent(evaledOperator->type == CLOSURE_TYPE ? TRACE_CLOSURE : TRACE_PRIMITIVE,
+                                   head->type == SYMBOL_TYPE ? head : head->local.symbol, 0);
+                    }
+                    if(evaledOperator->type != CLOSURE_TYPE) {
+                        return apply(evaledOperator,evaledArgs);
+                    }
+                    frame = bindArguments(evaledOperator, evaledArgs);
+                    tree = evaledOperator->cl.functionCode;
+                    if (profiling) {
+                        profileCall(evaledOperator, evalBase);
+                    }
+                    continue;
+                }
+                else {
+                    return tree;
                 }
             }
-            else {
+            case NULL_TYPE:
                 return tree;
-            }
-            // Sanity and error checking on first...
-            break;
-        case NULL_TYPE:
-            return tree;
-            break;
-        default:
-            //printf("Eval - not a value type\n");
-            evaluationError();      
-    }    
+                break;
+            default:
+                //printf("Eval - not a value type\n");
+                evaluationError();      
+        }    
+    }
     evaluationError();
     Value *nullThing = makeNull();
     return nullThing;
 }
 
-// Prints the correct output, given a Value*
-void printValue(Value* value){
-    if(value->type == NULL_TYPE) {
-        printf("()");
-    }
-    else if(value->type == INT_TYPE) {
-        printf("%i",value->i);   
-    }
-    else if(value->type == STR_TYPE) {
-        printf("\"%s\"",value->s);   
-    }
-    else if(value->type == DOUBLE_TYPE) {
-        printf("%f",value->d);   
+// Runs walk, recording the calls it makes when profiling
+Value *eval(Value *tree, Frame *frame) {
+    if (!profiling) {
+        return walk(tree, frame);
+    }
+    int saved = evalBase;
+    evalBase = profileDepth();
+    Value *value = walk(tree, frame);
+    profileUnwind(evalBase);
+    evalBase = saved;
+    return value;
+}
+
+// What printValue still has to print: a value as printed at top level, an
+// element of a list, the rest of a list after an
+// element, the elements of a vector or the entries of a hash table from index
+// on, or some text
+typedef enum {PRINT_VALUE, PRINT_ITEM, PRINT_REST, PRINT_ELEMENTS, PRINT_ENTRIES, PRINT_TEXT} printKind;
+
+typedef struct {
+    printKind kind;
+    Value *value;
+    char *text;
+    int64_t index;
+} PrintTask;
+
+// The stack of what printValue still has to print, kept between calls
+static PrintTask *printTasks = NULL;
+static size_t printCapacity = 0;
+
+// Pushes something for printValue to print
+static void pushPrint(size_t *count, printKind kind, Value *value, char *text) {
+    if (*count == printCapacity) {
+        printCapacity = printCapacity == 0 ? 64 : printCapacity * 2;
+        printTasks = realloc(printTasks, printCapacity * sizeof(PrintTask));
     }
-    else if(value->type == BOOL_TYPE) {
-        if(value->i == 0) {
-            printf("#f");
+    printTasks[(*count)++] = (PrintTask) {kind, value, text, 0};
+}
+
+// Prints the correct output, given a Value*. Lists are printed with an
+// explicit stack instead of by recursion, so however long or deeply nested
+// they are, printing them can't overflow the C stack. Inside a list, booleans
+// print as 1 and 0.
+void printValue(Value* value){
+    size_t count = 0;
+    pushPrint(&count, PRINT_VALUE, value, NULL);
+    while (count > 0) {
+        PrintTask task = printTasks[--count];
+        value = task.value;
+        switch (task.kind) {
+            case PRINT_TEXT:
+                writeText(task.text);
+                continue;
+            case PRINT_ELEMENTS:
+                if (task.index < value->vec.size) {
+                    if (task.index > 0) {
+                        writeChar(' ');
+                    }
+                    pushPrint(&count, PRINT_ELEMENTS, value, NULL);
+                    printTasks[count - 1].index = task.index + 1;
+                    pushPrint(&count, PRINT_VALUE, value->vec.items[task.index], NULL);
+                } else {
+                    writeChar(')');
+                }
+                continue;
+            case PRINT_ENTRIES: {
+                HashTable *table = value->hash;
+                int64_t index = task.index;
+                while (index < (int64_t) table->capacity && table->entries[index].key == NULL) {
+                    index++;
+                }
+                if (index == (int64_t) table->capacity) {
+                    writeChar(')');
+                    continue;
+                }
+                // Each entry prints as (key . value)
+                writeText(task.text);
+                pushPrint(&count, PRINT_ENTRIES, value, " (");
+                printTasks[count - 1].index = index + 1;
+                pushPrint(&count, PRINT_TEXT, NULL, ")");
+                pushPrint(&count, PRINT_VALUE, table->entries[index].value, NULL);
+                pushPrint(&count, PRINT_TEXT, NULL, " . ");
+                pushPrint(&count, PRINT_VALUE, table->entries[index].key, NULL);
+                continue;
+            }
+            case PRINT_REST:
+                // What follows an element of a list
+                if (value->type == CONS_TYPE) {
+                    writeChar(' ');
+                    pushPrint(&count, PRINT_REST, cdr(value), NULL);
+                    pushPrint(&count, PRINT_ITEM, car(value), NULL);
+                } else if (value->type != NULL_TYPE) {
+                    writeText(" . ");
+                    pushPrint(&count, PRINT_ITEM, value, NULL);
+                }
+                continue;
+            case PRINT_ITEM:
+                if (value->type == BOOL_TYPE) {
+                    writeChar(value->i == 0 ? '0' : '1');
+                    continue;
+                }
+                if (value->type == SYMBOL_TYPE) {
+                    writeText(value->s);
+                    continue;
+                }
+                if (value->type == NULL_TYPE || value->type == CONS_TYPE) {
+                    writeChar('(');
+                    pushPrint(&count, PRINT_TEXT, NULL, ")");
+                    if (value->type == CONS_TYPE) {
+                        pushPrint(&count, PRINT_REST, cdr(value), NULL);
+                        pushPrint(&count, PRINT_ITEM, car(value), NULL);
+                    }
+                    continue;
+                }
+                break;
+            case PRINT_VALUE:
+                break;
         }
-        else {
-            printf("#t");   
+
+        if(value->type == NULL_TYPE) {
+            writeText("()");
         }
-    }
-    else if(value->type == SYMBOL_TYPE) {
-        if (!strcmp(value->s,"quote") || !strcmp(value->s,"\'")){
-            printf("\'");
-        }else{
-            printf("%s",value->s);  
+        else if(value->type == INT_TYPE) {
+            writeInt(value->i);
         }
-    
-    }else if(value->type == OPEN_TYPE) {
-        printf("(");   
-    }else if(value->type == CLOSE_TYPE) {
-        printf(")");   
-    }else if(value->type == CONS_TYPE) {
-        
-        if (cdr(value)->type != CONS_TYPE && cdr(value)->type != NULL_TYPE ){
-            
-            printf("(");
-            printValue(car(value));
-            printf(" . ");
-            printValue(cdr(value));
-            printf(")");
-        }else{
-            printf("(");
-            printTree(value);
-            printf(")");
+        else if(value->type == STR_TYPE) {
+            writeChar('"');
+            writeText(value->s);
+            writeChar('"');
         }
-        
-    }else if(value->type == CLOSURE_TYPE) {
-        printf("#<procedure>");
-    }else if(value->type == VOID_TYPE) {
-    }else{
-        //printf("\n ERROR- not a value \n");
-    }
-
-}
-
-// This is essentially the same as printTree from parser.c, but has been modified
-// so that we can print in the racket style
-// In input.5, we need to fix (quote a) so that it returns 'a and not a
-void printTree_2(Value* value) {
-    while (value->type != NULL_TYPE){
-        if (car(value)->type == CONS_TYPE){
-            if (!strcmp(car(car(value))->s,"quote") || !strcmp(car(car(value))->s,"\'")){
-                printf("#\n");
-                printf(" ");
-                printTree(car(value)); printf("\n");
-                printTree_2(car(value));
-            }
-            else {
-                printf("!\n");
-                printf("(");
-                printTree_2(car(value));
-                printf(")");
-            } 
-        }else {
-            printValue(car(value));  
+        else if(value->type == DOUBLE_TYPE) {
+            writeDouble(value->d);
+        }
+        else if(value->type == BOOL_TYPE) {
+            writeText(value->i == 0 ? "#f" : "#t");
         }
-        if(cdr(value)->type != NULL_TYPE) {  
-            if (car(cdr(value))->type != CONS_TYPE){
-                printf(" ");
+        else if(value->type == SYMBOL_TYPE) {
+            if (value == quoteSymbol || value == tickSymbol){
+                writeChar('\'');
+            }else{
+                writeText(value->s);
+            }
+        }else if(value->type == OPEN_TYPE) {
+            writeChar('(');
+        }else if(value->type == CLOSE_TYPE) {
+            writeChar(')');
+        }else if(value->type == CONS_TYPE) {
+            writeChar('(');
+            pushPrint(&count, PRINT_TEXT, NULL, ")");
+            if (cdr(value)->type != CONS_TYPE && cdr(value)->type != NULL_TYPE ){
+                pushPrint(&count, PRINT_VALUE, cdr(value), NULL);
+                pushPrint(&count, PRINT_TEXT, NULL, " . ");
+                pushPrint(&count, PRINT_VALUE, car(value), NULL);
+            }else{
+                pushPrint(&count, PRINT_REST, cdr(value), NULL);
+                pushPrint(&count, PRINT_ITEM, car(value), NULL);
             }
-        }   
-        value = cdr(value);
-    } 
-}
\ No newline at end of file
+        }else if(value->type == VECTOR_TYPE) {
+            writeText("#(");
+            pushPrint(&count, PRINT_ELEMENTS, value, NULL);
+        }else if(value->type == HASH_TYPE) {
+            writeText(value->hash->equal ? "#hash(" : "#hasheq(");
+            pushPrint(&count, PRINT_ENTRIES, value, "(");
+        }else if(value->type == CLOSURE_TYPE || value->type == PRIMITIVE_TYPE) {
+            writeText("#<procedure>");
+        }
+    }
+}
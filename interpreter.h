@@ -1,22 +1,80 @@
+#include "value.h"
+#include "globals.h"
+
 #ifndef _INTERPRETER
 #define _INTERPRETER
 
-// A frame is a linked list of bindings, and a pointer to another frame.  A
-// binding is a variable name (represented as a string), and a pointer to the
-// Value it is bound to. Specifically how you implement the list of bindings is
-// up to you.
+// A frame is one block holding the values of the variables bound by a lambda
+// call or a let, in the slots the resolver assigned them (see resolve.h), and
+// a pointer to the enclosing frame. The scope gives the names of the slots.
+// The top-level frame has no scope or slots; its globals hold every variable
+// defined at top level, and the primitives (see globals.h).
 
 struct Frame {
-    Value *bindings;
+    Globals *globals;
     struct Frame *parent;
+    Value *scope;
+    Value *slots[];
 };
 
 typedef struct Frame Frame;
 
-    
-void interpret(Value *tree);
+// An execution engine runs a resolved top-level expression in the top-level
+// frame and returns its value. eval walks the tree directly; vm.h compiles it
+// to bytecode first, and analyze.h turns it into a tree of C functions.
+//
+// call runs the body of a closure in the frame made for a call to it. The
+// primitives that take procedures, such as map, call closures with the
+// running engine's call (see applyProcedure).
+typedef struct Engine {
+    Value *(*run)(Value *expr, Frame *frame);
+    Value *(*call)(Value *closure, Frame *frame);
+} Engine;
+
+// The tree walking engine, which runs expressions with eval
+extern Engine treeWalker;
+
+// Creates the top-level frame, with every primitive bound in it
+Frame *newTopFrame();
+
+// Runs one top-level expression in the top-level frame with the given engine,
+// and prints its value
+void interpret(Value *expr, Frame *top, Engine *engine);
 
 Value *eval(Value *expr, Frame *frame);
 
+// Calls a closure with eval, or a primitive, on a list of arguments
+Value *apply(Value *function, Value *args);
+
+// Prints a value as the interpreter prints results
+void printValue(Value *value);
+
+// Shared with the other execution engines, which use the same frames and
+// report errors the same way
+Frame *newFrame(Value *scope, Frame *parent);
+Value **slotAddress(Value *local, Frame *frame);
+Frame *topFrame(Frame *frame);
+// The number of frames made since the program started
+size_t framesMade();
+Value *lookUpSymbol(Value *tree, Frame *frame);
+Value *findPair(Value *tree, Frame *frame);
+void evaluationError();
+
+// The arithmetic and comparison primitives, which fold.c calls on constants
+Value *primitiveAdd(Value *args);
+Value *primitiveSubtract(Value *args);
+Value *primitiveMult(Value *args);
+Value *primitiveDivide(Value *args);
+Value *primitiveModulo(Value *args);
+Value *primitiveLessThan(Value *args);
+Value *primitiveGreaterThan(Value *args);
+Value *primitiveEqualTo(Value *args);
+Value *primitiveLessThanEqualTo(Value *args);
+Value *primitiveGreaterThanEqualTo(Value *args);
+
+// Calls a closure or primitive on a list of arguments, with the engine that
+// is running, and returns its value
+Value *applyProcedure(Value *function, Value *args);
+
 #endif
 
@@ -0,0 +1,100 @@
+// linkedlist.c
+
+// The cons cells everything else is built from.
+
+#include <stdio.h>
+#include <assert.h>
+#include "value.h"
+#include "talloc.h"
+#include "linkedlist.h"
+
+Value *makeNull() {
+    return makeEmptyList();
+}
+
+Value *cons(Value *car, Value *cdr) {
+    Value *cell = newValue(CONS_TYPE);
+    cell->c.car = car;
+    cell->c.cdr = cdr;
+    return cell;
+}
+
+// Prints one item of a list for display
+static void displayItem(Value *item) {
+    switch (item->type) {
+        case INT_TYPE:
+            printf("%lld", (long long) item->i);
+            break;
+        case DOUBLE_TYPE:
+            printf("%f", item->d);
+            break;
+        case STR_TYPE:
+            printf("\"%s\"", item->s);
+            break;
+        case SYMBOL_TYPE:
+            printf("%s", item->s);
+            break;
+        case BOOL_TYPE:
+            printf(item->i ? "#t" : "#f");
+            break;
+        case NULL_TYPE:
+            printf("()");
+            break;
+        case CONS_TYPE:
+            display(item);
+            break;
+        default:
+            printf("?");
+            break;
+    }
+}
+
+void display(Value *list) {
+    printf("(");
+    while (list->type == CONS_TYPE) {
+        displayItem(list->c.car);
+        list = list->c.cdr;
+        if (list->type == CONS_TYPE) {
+            printf(" ");
+        }
+    }
+    printf(")\n");
+}
+
+Value *reverse(Value *list) {
+    assert(list != NULL);
+    Value *reversed = makeNull();
+    while (list->type != NULL_TYPE) {
+        reversed = cons(car(list), reversed);
+        list = cdr(list);
+    }
+    return reversed;
+}
+
+Value *car(Value *list) {
+    assert(list != NULL);
+    assert(list->type == CONS_TYPE);
+    assert(list->c.car != NULL);
+    return list->c.car;
+}
+
+Value *cdr(Value *list) {
+    assert(list != NULL);
+    assert(list->type == CONS_TYPE);
+    assert(list->c.cdr != NULL);
+    return list->c.cdr;
+}
+
+bool isNull(Value *value) {
+    assert(value != NULL);
+    return value->type == NULL_TYPE;
+}
+
+int length(Value *value) {
+    int count = 0;
+    while (!isNull(value)) {
+        count++;
+        value = cdr(value);
+    }
+    return count;
+}
@@ -0,0 +1,262 @@
+// lists.c
+
+// The list library, built on the cons cells of linkedlist.h.
+
+#include "value.h"
+#include "linkedlist.h"
+#include "talloc.h"
+#include "interpreter.h"
+#include "hash.h"
+#include "lists.h"
+
+// Returns the length of a proper list, or reports an evaluation error if it
+// isn't one
+static int64_t properLength(Value *list) {
+    int64_t count = 0;
+    while (list->type == CONS_TYPE) {
+        count++;
+        list = list->c.cdr;
+    }
+    if (list->type != NULL_TYPE) {
+        evaluationError();
+    }
+    return count;
+}
+
+// Checks the argument list has between min and max arguments
+static void checkCount(Value *args, int min, int max) {
+    int64_t count = properLength(args);
+    if (count < min || count > max) {
+        evaluationError();
+    }
+}
+
+// Returns true unless the value is #f
+static bool isTrue(Value *value) {
+    return value->type != BOOL_TYPE || value->i != 0;
+}
+
+// Copies a proper list, appending tail to the copy instead of the empty
+// list
+static Value *copyOnto(Value *list, Value *tail) {
+    properLength(list);
+    Value *copy = tail;
+    Value **end = &copy;
+    for (; list->type == CONS_TYPE; list = list->c.cdr) {
+        *end = cons(list->c.car, tail);
+        end = &(*end)->c.cdr;
+    }
+    return copy;
+}
+
+Value *primitiveList(Value *args) {
+    return args;
+}
+
+Value *primitiveLength(Value *args) {
+    checkCount(args, 1, 1);
+    return makeInt(properLength(car(args)));
+}
+
+Value *primitiveAppend(Value *args) {
+    if (args->type == NULL_TYPE) {
+        return makeNull();
+    }
+    // Copy the lists from the last but one back to the first, each onto the
+    // result so far
+    Value *lists = reverse(args);
+    Value *result = car(lists);
+    for (lists = cdr(lists); lists->type == CONS_TYPE; lists = lists->c.cdr) {
+        result = copyOnto(lists->c.car, result);
+    }
+    return result;
+}
+
+Value *primitiveReverse(Value *args) {
+    checkCount(args, 1, 1);
+    properLength(car(args));
+    return reverse(car(args));
+}
+
+Value *primitiveListRef(Value *args) {
+    checkCount(args, 2, 2);
+    Value *list = car(args);
+    Value *index = car(cdr(args));
+    if (index->type != INT_TYPE || index->i < 0) {
+        evaluationError();
+    }
+    for (int64_t i = index->i; i > 0 && list->type == CONS_TYPE; i--) {
+        list = list->c.cdr;
+    }
+    if (list->type != CONS_TYPE) {
+        evaluationError();
+    }
+    return list->c.car;
+}
+
+// Checks the arguments after the first skip are proper lists of the same
+// length, and returns the length
+static int64_t commonLength(Value *args, int skip) {
+    for (; skip > 0; skip--) {
+        args = cdr(args);
+    }
+    if (args->type == NULL_TYPE) {
+        evaluationError();
+    }
+    int64_t size = properLength(car(args));
+    for (args = cdr(args); args->type == CONS_TYPE; args = args->c.cdr) {
+        if (properLength(args->c.car) != size) {
+            evaluationError();
+        }
+    }
+    return size;
+}
+
+// Takes the first element of each of the lists, followed by extra, as the
+// arguments of a call, and moves each list on to its next element
+static Value *nextArguments(Value *lists, Value *extra) {
+    Value *arguments = extra;
+    Value **end = &arguments;
+    for (; lists->type == CONS_TYPE; lists = lists->c.cdr) {
+        Value *list = lists->c.car;
+        *end = cons(list->c.car, extra);
+        end = &(*end)->c.cdr;
+        lists->c.car = list->c.cdr;
+    }
+    return arguments;
+}
+
+// Calls the procedure that is the first argument on successive elements of
+// the lists that follow it, returning a list of the results if collect is
+// set
+static Value *mapLists(Value *args, bool collect) {
+    checkCount(args, 2, INT32_MAX);
+    Value *function = car(args);
+    int64_t size = commonLength(args, 1);
+    // A copy of the list of lists, whose elements nextArguments moves along
+    Value *lists = copyOnto(cdr(args), makeNull());
+    Value *results = makeNull();
+    Value **end = &results;
+    for (int64_t i = 0; i < size; i++) {
+        Value *result = applyProcedure(function, nextArguments(lists, makeNull()));
+        if (collect) {
+            *end = cons(result, makeNull());
+            end = &(*end)->c.cdr;
+        }
+    }
+    return collect ? results : makeVoid();
+}
+
+Value *primitiveMap(Value *args) {
+    return mapLists(args, true);
+}
+
+Value *primitiveForEach(Value *args) {
+    return mapLists(args, false);
+}
+
+Value *primitiveFilter(Value *args) {
+    checkCount(args, 2, 2);
+    Value *function = car(args);
+    Value *list = car(cdr(args));
+    properLength(list);
+    Value *kept = makeNull();
+    Value **end = &kept;
+    for (; list->type == CONS_TYPE; list = list->c.cdr) {
+        if (isTrue(applyProcedure(function, cons(list->c.car, makeNull())))) {
+            *end = cons(list->c.car, makeNull());
+            end = &(*end)->c.cdr;
+        }
+    }
+    return kept;
+}
+
+Value *primitiveFoldl(Value *args) {
+    checkCount(args, 3, INT32_MAX);
+    Value *function = car(args);
+    Value *result = car(cdr(args));
+    int64_t size = commonLength(args, 2);
+    Value *lists = copyOnto(cdr(cdr(args)), makeNull());
+    for (int64_t i = 0; i < size; i++) {
+        result = applyProcedure(function, nextArguments(lists, cons(result, makeNull())));
+    }
+    return result;
+}
+
+Value *primitiveAssoc(Value *args) {
+    checkCount(args, 2, 2);
+    Value *key = car(args);
+    Value *list = car(cdr(args));
+    properLength(list);
+    for (; list->type == CONS_TYPE; list = list->c.cdr) {
+        Value *pair = list->c.car;
+        if (pair->type != CONS_TYPE) {
+            evaluationError();
+        }
+        if (valuesEqual(pair->c.car, key)) {
+            return pair;
+        }
+    }
+    return makeBool(false);
+}
+
+// Merges two sorted runs of cons cells, relinking them. Ties go to the first
+// run, which keeps the sort stable.
+static Value *merge(Value *first, Value *second, Value *less) {
+    Value *merged = makeNull();
+    Value **end = &merged;
+    while (first->type == CONS_TYPE && second->type == CONS_TYPE) {
+        Value *arguments = cons(second->c.car, cons(first->c.car, makeNull()));
+        if (isTrue(applyProcedure(less, arguments))) {
+            *end = second;
+            second = second->c.cdr;
+        } else {
+            *end = first;
+            first = first->c.cdr;
+        }
+        end = &(*end)->c.cdr;
+    }
+    *end = first->type == CONS_TYPE ? first : second;
+    return merged;
+}
+
+Value *primitiveSort(Value *args) {
+    checkCount(args, 2, 2);
+    Value *less = car(cdr(args));
+    Value *list = copyOnto(car(args), makeNull());
+    int64_t size = properLength(list);
+
+    // Bottom up: merge runs of one, then of two, and so on, relinking the
+    // cells of the copy
+    for (int64_t width = 1; width < size; width *= 2) {
+        Value *sorted = makeNull();
+        Value **end = &sorted;
+        Value *rest = list;
+        while (rest->type == CONS_TYPE) {
+            // Cut off two runs of width cells
+            Value *first = rest;
+            Value *second = makeNull();
+            Value *cell = first;
+            for (int64_t i = 1; i < width && cell->c.cdr->type == CONS_TYPE; i++) {
+                cell = cell->c.cdr;
+            }
+            second = cell->c.cdr;
+            cell->c.cdr = makeNull();
+            rest = makeNull();
+            if (second->type == CONS_TYPE) {
+                cell = second;
+                for (int64_t i = 1; i < width && cell->c.cdr->type == CONS_TYPE; i++) {
+                    cell = cell->c.cdr;
+                }
+                rest = cell->c.cdr;
+                cell->c.cdr = makeNull();
+            }
+            *end = merge(first, second, less);
+            while ((*end)->type == CONS_TYPE) {
+                end = &(*end)->c.cdr;
+            }
+        }
+        list = sorted;
+    }
+    return list;
+}
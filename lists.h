@@ -0,0 +1,49 @@
+#include "value.h"
+
+#ifndef _LISTS
+#define _LISTS
+
+// The list library. These would otherwise have to be written in Racket, with
+// every element costing a call through eval. Each takes its arguments as a
+// list and reports bad arguments, including lists that aren't proper lists,
+// with an evaluation error. Procedures passed to them are called with
+// applyProcedure, so they run on whichever engine is running.
+
+// (list v ...)
+Value *primitiveList(Value *args);
+
+// (length list)
+Value *primitiveLength(Value *args);
+
+// (append list ...): every list but the last is copied
+Value *primitiveAppend(Value *args);
+
+// (reverse list)
+Value *primitiveReverse(Value *args);
+
+// (list-ref list k): element k, counting from 0
+Value *primitiveListRef(Value *args);
+
+// (map proc list ...) and (for-each proc list ...): call proc on the first
+// elements of the lists, then the second, and so on. The lists must be the
+// same length. map returns a list of the results.
+Value *primitiveMap(Value *args);
+Value *primitiveForEach(Value *args);
+
+// (filter pred list): the elements pred doesn't return #f for
+Value *primitiveFilter(Value *args);
+
+// (foldl proc init list ...): calls proc on the first elements of the lists
+// and init, then on the second elements and that result, and so on, and
+// returns the last result
+Value *primitiveFoldl(Value *args);
+
+// (assoc key list): the first pair in an association list whose car is
+// equal? to key, or #f
+Value *primitiveAssoc(Value *args);
+
+// (sort list less-than?): a sorted copy of the list. The sort is a stable
+// merge sort, so elements neither is less than stay in their original order.
+Value *primitiveSort(Value *args);
+
+#endif
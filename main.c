@@ -1,17 +1,94 @@
 #include <stdio.h>
-#include "tokenizer.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
 #include "value.h"
-#include "linkedlist.h"
-#include "parser.h"
 #include "talloc.h"
 #include "interpreter.h"
+#include "reader.h"
+#include "vm.h"
+#include "analyze.h"
+#include "output.h"
+#include "profile.h"
+#include "stats.h"
+#include "trace.h"
+#include "fold.h"
 
-int main() {
+int main(int argc, char **argv) {
 
-    Value *list = tokenize(stdin);
-    Value *tree = parse(list);
-    interpret(tree);
+    // Options for choosing the execution engine, turning off folding,
+    // profiling, tracing, reporting on memory, and sizing the garbage
+    // collected heap
+    // Anything else names a file to run, in order, in place of stdin
+    Engine *engine = &treeWalker;
+    char **files = malloc(argc * sizeof(char *));
+    int fileCount = 0;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--vm")) {
+            engine = &virtualMachine;
+        } else if (!strcmp(argv[i], "--analyze")) {
+            engine = &analyzer;
+        } else if (!strcmp(argv[i], "--no-fold")) {
+            folding = false;
+        } else if (!strcmp(argv[i], "--profile")) {
+            startProfiling("profile.folded");
+        } else if (!strncmp(argv[i], "--profile=", 10)) {
+            startProfiling(argv[i] + 10);
+        } else if (!strcmp(argv[i], "--trace")) {
+            startTracing("trace.out");
+        } else if (!strncmp(argv[i], "--trace=", 8)) {
+            startTracing(argv[i] + 8);
+        } else if (!strcmp(argv[i], "--stats")) {
+            startStats();
+        } else if (!strcmp(argv[i], "--gc-stats")) {
+            reportCollections(true);
+        } else if (!strncmp(argv[i], "--gc-threshold=", 15)) {
+            setCollectionThreshold(strtoul(argv[i] + 15, NULL, 10));
+        } else if (argv[i][0] == '-') {
+            fprintf(stderr, "usage: %s [--vm | --analyze] [--no-fold] [--profile[=FILE]] [--trace[=FILE]] [--stats] [--gc-stats] [--gc-threshold=BYTES] [file ...]\n", argv[0]);
+            return 1;
+        } else {
+            files[fileCount++] = argv[i];
+        }
+    }
 
+    // Read, evaluate and print one expression at a time, prompting for each
+    // one if the input is a terminal
+    Frame *top = newTopFrame();
+    if (fileCount == 0) {
+        Reader reader;
+        openStream(&reader, stdin);
+        bool interactive = isatty(STDIN_FILENO);
+        while (true) {
+            if (interactive) {
+                writeText("> ");
+                flushOutput();
+            }
+            Value *expr = readDatum(&reader);
+            if (expr == NULL) {
+                break;
+            }
+            interpret(expr, top, engine);
+        }
+        if (interactive) {
+            writeLine();
+        }
+    }
+    for (int i = 0; i < fileCount; i++) {
+        Reader reader;
+        if (!openFile(&reader, files[i])) {
+            fprintf(stderr, "%s: %s\n", files[i], strerror(errno));
+            tfree();
+            return 1;
+        }
+        Value *expr;
+        while ((expr = readDatum(&reader)) != NULL) {
+            interpret(expr, top, engine);
+        }
+    }
+
+    free(files);
     tfree();
     return 0;
 }
@@ -0,0 +1,145 @@
+// output.c
+
+// The output buffer. Numbers are formatted by hand straight into it: integers
+// digit by digit, and doubles as their integer part followed by the fraction
+// rounded exactly to six places, which is what %f prints. Only doubles too big
+// for a 64-bit integer part, and infinities and NaNs, go through snprintf.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <unistd.h>
+#include "output.h"
+
+#define OUTPUT_SIZE (1 << 16)
+
+static char buffer[OUTPUT_SIZE];
+static size_t used = 0;
+
+// Whether stdout is a terminal: 0 if that hasn't been checked yet, 1 if it
+// is, and -1 if it isn't
+static int terminal = 0;
+static bool registered = false;
+
+void flushOutput() {
+    size_t written = 0;
+    while (written < used) {
+        ssize_t count = write(STDOUT_FILENO, buffer + written, used - written);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        written += count;
+    }
+    used = 0;
+}
+
+// Makes sure there is room for the given number of characters
+static void reserve(size_t size) {
+    if (!registered) {
+        atexit(flushOutput);
+        registered = true;
+    }
+    if (used + size > OUTPUT_SIZE) {
+        flushOutput();
+    }
+}
+
+void writeChar(char c) {
+    reserve(1);
+    buffer[used++] = c;
+}
+
+void writeText(char *text) {
+    size_t length = strlen(text);
+    while (length > 0) {
+        reserve(1);
+        size_t chunk = OUTPUT_SIZE - used < length ? OUTPUT_SIZE - used : length;
+        memcpy(buffer + used, text, chunk);
+        used += chunk;
+        text += chunk;
+        length -= chunk;
+    }
+}
+
+// Appends the digits of an unsigned integer
+static void writeDigits(uint64_t n) {
+    char digits[20];
+    int count = 0;
+    do {
+        digits[count++] = '0' + n % 10;
+        n /= 10;
+    } while (n != 0);
+    reserve(count);
+    while (count > 0) {
+        buffer[used++] = digits[--count];
+    }
+}
+
+void writeInt(int64_t i) {
+    if (i < 0) {
+        writeChar('-');
+        writeDigits(0 - (uint64_t) i);
+    } else {
+        writeDigits(i);
+    }
+}
+
+void writeDouble(double d) {
+    double magnitude = fabs(d);
+    if (!(magnitude < 0x1p63)) {
+        char text[400];
+        snprintf(text, sizeof(text), "%f", d);
+        writeText(text);
+        return;
+    }
+    uint64_t whole = (uint64_t) magnitude;
+    double fraction = magnitude - (double) whole;
+
+    // The fraction is m / 2^e for an integer m below 2^53. Fractions under
+    // 2^-21 round to zero, so e is at most 74, and m * 10^6 fits in 128 bits.
+    uint64_t millionths = 0;
+    if (fraction >= 0x1p-21) {
+        int exponent;
+        double mantissa = frexp(fraction, &exponent);
+        unsigned __int128 scaled = (unsigned __int128) (uint64_t) ldexp(mantissa, 53) * 1000000;
+        int shift = 53 - exponent;
+        millionths = (uint64_t) (scaled >> shift);
+        unsigned __int128 rest = scaled & (((unsigned __int128) 1 << shift) - 1);
+        unsigned __int128 half = (unsigned __int128) 1 << (shift - 1);
+        if (rest > half || (rest == half && (millionths & 1))) {
+            millionths++;
+        }
+        if (millionths == 1000000) {
+            millionths = 0;
+            whole++;
+        }
+    }
+
+    if (signbit(d)) {
+        writeChar('-');
+    }
+    writeDigits(whole);
+    char digits[7] = {'.'};
+    for (int i = 6; i > 0; i--) {
+        digits[i] = '0' + millionths % 10;
+        millionths /= 10;
+    }
+    reserve(7);
+    memcpy(buffer + used, digits, 7);
+    used += 7;
+}
+
+void writeLine() {
+    writeChar('\n');
+    if (terminal == 0) {
+        terminal = isatty(STDOUT_FILENO) ? 1 : -1;
+    }
+    if (terminal > 0) {
+        flushOutput();
+    }
+}
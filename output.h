@@ -0,0 +1,31 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifndef _OUTPUT
+#define _OUTPUT
+
+// The buffer everything the interpreter prints to stdout goes through. Output
+// is collected here and written with a single write call when the buffer
+// fills or is flushed, instead of going through printf a token at a time.
+// Output still buffered when the program exits is flushed then.
+
+// Appends a character to the output
+void writeChar(char c);
+
+// Appends a NUL-terminated string to the output
+void writeText(char *text);
+
+// Appends an integer in decimal
+void writeInt(int64_t i);
+
+// Appends a double with six decimal places, as printf's %f would
+void writeDouble(double d);
+
+// Ends a line. If stdout is a terminal, the line is written straight away, as
+// stdio would.
+void writeLine();
+
+// Writes out everything in the buffer
+void flushOutput();
+
+#endif
@@ -0,0 +1,318 @@
+// profile.c
+
+// The profiler's records. Each procedure gets a record, found by hashing the
+// address of its key: the scope of a closure's lambda, which every closure
+// made from that lambda shares, or the primitive itself. The calls on the
+// stack also walk down a tree with a node for each distinct stack of calls
+// seen, and self time is charged to the node on top as well as to the
+// procedure, which gives the folded stacks.
+//
+// Records, nodes and the stack are malloced, so they outlive tfree and can
+// still be reported at exit. The keys are kept on a talloced list so the
+// collector can't free a scope and let another take its address.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include "value.h"
+#include "linkedlist.h"
+#include "talloc.h"
+#include "profile.h"
+
+typedef struct Procedure {
+    Value *key;
+    char *name;
+    // Whether name came from a define or bind, rather than the parameters
+    bool named;
+    uint64_t calls;
+    uint64_t inclusive;
+    uint64_t self;
+    uint64_t bytes;
+    // How many calls to the procedure are on the stack, and when the
+    // outermost of them started
+    int active;
+    uint64_t entered;
+} Procedure;
+
+typedef struct CallNode {
+    Procedure *procedure;
+    struct CallNode *parent;
+    struct CallNode *child;
+    struct CallNode *sibling;
+    uint64_t self;
+} CallNode;
+
+typedef struct Call {
+    Procedure *procedure;
+    CallNode *node;
+} Call;
+
+bool profiling = false;
+
+static char *foldedFile;
+
+static Procedure **procedures = NULL;
+static size_t procedureCapacity = 0;
+static size_t procedureCount = 0;
+static Value *keys;
+
+static CallNode root;
+static Call *stack = NULL;
+static int depth = 0;
+static int stackCapacity = 0;
+
+// When time and bytes were last charged to the call on top
+static uint64_t lastTime;
+static size_t lastBytes;
+
+static uint64_t nanoseconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static size_t hashKey(Value *key) {
+    return (size_t) (((uintptr_t) key >> 3) * 11400714819323198485ull >> 32);
+}
+
+// Names an unnamed closure by its lambda's parameters
+static char *parameterName(Value *scope) {
+    size_t size = sizeof("lambda()");
+    Value *names = scope->scope.names;
+    for (int i = 0; i < scope->scope.params; i++, names = cdr(names)) {
+        size += strlen(car(names)->s) + 1;
+    }
+    char *name = malloc(size);
+    strcpy(name, "lambda(");
+    names = scope->scope.names;
+    for (int i = 0; i < scope->scope.params; i++, names = cdr(names)) {
+        if (i > 0) {
+            strcat(name, ",");
+        }
+        strcat(name, car(names)->s);
+    }
+    strcat(name, ")");
+    return name;
+}
+
+// Returns the record for a closure or primitive, making it if need be
+static Procedure *findProcedure(Value *procedure) {
+    Value *key = procedure->type == CLOSURE_TYPE ? procedure->cl.scope : procedure;
+    if (2 * (procedureCount + 1) > procedureCapacity) {
+        Procedure **old = procedures;
+        size_t oldCapacity = procedureCapacity;
+        procedureCapacity = procedureCapacity == 0 ? 256 : procedureCapacity * 2;
+        procedures = calloc(procedureCapacity, sizeof(Procedure *));
+        for (size_t i = 0; i < oldCapacity; i++) {
+            if (old[i] != NULL) {
+                size_t index = hashKey(old[i]->key) & (procedureCapacity - 1);
+                while (procedures[index] != NULL) {
+                    index = (index + 1) & (procedureCapacity - 1);
+                }
+                procedures[index] = old[i];
+            }
+        }
+        free(old);
+    }
+    size_t index = hashKey(key) & (procedureCapacity - 1);
+    while (procedures[index] != NULL) {
+        if (procedures[index]->key == key) {
+            return procedures[index];
+        }
+        index = (index + 1) & (procedureCapacity - 1);
+    }
+    Procedure *record = calloc(1, sizeof(Procedure));
+    record->key = key;
+    record->name = key->type == SCOPE_TYPE ? parameterName(key) : strdup("primitive");
+    procedures[index] = record;
+    procedureCount++;
+    keys = cons(key, keys);
+    return record;
+}
+
+void nameProcedure(Value *procedure, char *name) {
+    if (!profiling) {
+        return;
+    }
+    Procedure *record = findProcedure(procedure);
+    if (!record->named) {
+        free(record->name);
+        record->name = strdup(name);
+        record->named = true;
+    }
+}
+
+// Charges the time and bytes since the last charge to the call on top
+static void charge() {
+    uint64_t now = nanoseconds();
+    size_t bytes = bytesAllocated();
+    if (depth > 0) {
+        Call *top = &stack[depth - 1];
+        top->procedure->self += now - lastTime;
+        top->procedure->bytes += bytes - lastBytes;
+        top->node->self += now - lastTime;
+    } else {
+        root.self += now - lastTime;
+    }
+    lastTime = now;
+    lastBytes = bytes;
+}
+
+// Pushes a call, after charging the time before it
+static void push(Procedure *procedure) {
+    charge();
+    if (depth == stackCapacity) {
+        stackCapacity = stackCapacity == 0 ? 256 : stackCapacity * 2;
+        stack = realloc(stack, stackCapacity * sizeof(Call));
+    }
+    CallNode *parent = depth > 0 ? stack[depth - 1].node : &root;
+    CallNode *node = parent->child;
+    while (node != NULL && node->procedure != procedure) {
+        node = node->sibling;
+    }
+    if (node == NULL) {
+        node = calloc(1, sizeof(CallNode));
+        node->procedure = procedure;
+        node->parent = parent;
+        node->sibling = parent->child;
+        parent->child = node;
+    }
+    procedure->calls++;
+    if (procedure->active++ == 0) {
+        procedure->entered = lastTime;
+    }
+    stack[depth].procedure = procedure;
+    stack[depth].node = node;
+    depth++;
+}
+
+// Pops the call on top, after charging the time in it
+static void pop() {
+    charge();
+    Procedure *procedure = stack[--depth].procedure;
+    if (--procedure->active == 0) {
+        procedure->inclusive += lastTime - procedure->entered;
+    }
+}
+
+int profileDepth() {
+    return depth;
+}
+
+void profileCall(Value *closure, int base) {
+    if (depth > base) {
+        pop();
+    }
+    push(findProcedure(closure));
+}
+
+void profileEnter(Value *closure) {
+    push(findProcedure(closure));
+}
+
+void profileReturn() {
+    pop();
+}
+
+void profileUnwind(int base) {
+    while (depth > base) {
+        pop();
+    }
+}
+
+Value *profilePrimitive(Value *primitive, Value *args) {
+    int base = depth;
+    push(findProcedure(primitive));
+    Value *result = primitive->pf(args);
+    profileUnwind(base);
+    return result;
+}
+
+static int compareSelf(const void *a, const void *b) {
+    const Procedure *first = *(Procedure **) a;
+    const Procedure *second = *(Procedure **) b;
+    return (first->self < second->self) - (first->self > second->self);
+}
+
+// Writes a line for every node with self time, giving the names on the path
+// to it and the time in microseconds
+static void writeFolded(FILE *file) {
+    if (root.self > 0) {
+        fprintf(file, "(top level) %llu\n", (unsigned long long) (root.self / 1000));
+    }
+    Procedure **path = NULL;
+    int pathCapacity = 0;
+    int pathLength = 0;
+    CallNode *node = root.child;
+    while (node != NULL) {
+        if (pathLength == pathCapacity) {
+            pathCapacity = pathCapacity == 0 ? 64 : pathCapacity * 2;
+            path = realloc(path, pathCapacity * sizeof(Procedure *));
+        }
+        path[pathLength++] = node->procedure;
+        if (node->self >= 1000) {
+            for (int i = 0; i < pathLength; i++) {
+                fprintf(file, i == 0 ? "%s" : ";%s", path[i]->name);
+            }
+            fprintf(file, " %llu\n", (unsigned long long) (node->self / 1000));
+        }
+        // On to the first child, or else the next sibling of this node or
+        // of the nearest ancestor that has one
+        if (node->child != NULL) {
+            node = node->child;
+            continue;
+        }
+        while (node != &root && node->sibling == NULL) {
+            node = node->parent;
+            pathLength--;
+        }
+        if (node == &root) {
+            break;
+        }
+        node = node->sibling;
+        pathLength--;
+    }
+    free(path);
+}
+
+// Prints the report and writes the folded stacks
+static void report() {
+    profileUnwind(0);
+    charge();
+
+    Procedure **sorted = malloc((procedureCount + 1) * sizeof(Procedure *));
+    size_t count = 0;
+    for (size_t i = 0; i < procedureCapacity; i++) {
+        if (procedures[i] != NULL && procedures[i]->calls > 0) {
+            sorted[count++] = procedures[i];
+        }
+    }
+    qsort(sorted, count, sizeof(Procedure *), compareSelf);
+    fprintf(stderr, "%12s %14s %14s %14s  %s\n", "calls", "inclusive ms", "self ms", "self bytes",
+            "procedure");
+    for (size_t i = 0; i < count; i++) {
+        fprintf(stderr, "%12llu %14.3f %14.3f %14llu  %s\n", (unsigned long long) sorted[i]->calls,
+                sorted[i]->inclusive / 1e6, sorted[i]->self / 1e6,
+                (unsigned long long) sorted[i]->bytes, sorted[i]->name);
+    }
+    free(sorted);
+
+    FILE *file = fopen(foldedFile, "w");
+    if (file == NULL) {
+        perror(foldedFile);
+        return;
+    }
+    writeFolded(file);
+    fclose(file);
+}
+
+void startProfiling(char *foldedPath) {
+    profiling = true;
+    foldedFile = foldedPath;
+    keys = makeNull();
+    lastTime = nanoseconds();
+    lastBytes = bytesAllocated();
+    atexit(report);
+}
@@ -0,0 +1,47 @@
+#include <stdbool.h>
+#include "value.h"
+
+#ifndef _PROFILE
+#define _PROFILE
+
+// The profiler. When it is on, every call to a closure or primitive is
+// recorded on a stack of calls, and the time and talloced bytes between one
+// call or return and the next are charged to the procedure on top. At exit
+// it prints each procedure's calls, inclusive and self time, and self bytes
+// to stderr, busiest first, and writes the time spent in each distinct stack
+// of calls to a file in the folded format flame graph tools read.
+//
+// Closures are named by the global they were first defined as, and otherwise
+// by their parameters, as in lambda(x,y). Primitives are named by bind.
+//
+// The engines only call in here when profiling is set, so the profiler costs
+// a branch per call when it is off.
+
+extern bool profiling;
+
+// Turns the profiler on, writing folded stacks to the given file at exit
+void startProfiling(char *foldedPath);
+
+// Names a closure's lambda or a primitive, unless it already has a name
+void nameProcedure(Value *procedure, char *name);
+
+// Returns the number of calls on the stack
+int profileDepth();
+
+// Records a call to a closure. If the stack is deeper than base, the call
+// replaces the call on top, as a tail call does.
+void profileCall(Value *closure, int base);
+
+// Records a call to a closure that doesn't replace any other
+void profileEnter(Value *closure);
+
+// Records a return from the call on top
+void profileReturn();
+
+// Records returns from calls until only base are left
+void profileUnwind(int base);
+
+// Calls a primitive on a list of arguments, recording the call
+Value *profilePrimitive(Value *primitive, Value *args);
+
+#endif
@@ -0,0 +1,250 @@
+// reader.c
+
+// The streaming reader. readDatum reads one top-level datum at a time, so
+// main can evaluate and print each expression as soon as it has been read,
+// and the text of the ones before it can be collected.
+//
+// Files named on the command line are mapped into memory instead of being
+// read through stdio. Their text is scanned where it lies: strings are
+// terminated in place and point into the mapping, and symbols are interned
+// straight from it, so a name is only copied the first time it is seen.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "value.h"
+#include "linkedlist.h"
+#include "talloc.h"
+#include "symbol.h"
+#include "scan.h"
+#include "reader.h"
+
+void openStream(Reader *reader, FILE *stream) {
+    reader->stream = stream;
+    reader->text = NULL;
+    reader->length = 0;
+    reader->position = 0;
+}
+
+bool openFile(Reader *reader, char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) < 0) {
+        close(fd);
+        return false;
+    }
+    openStream(reader, NULL);
+    if (info.st_size > 0) {
+        // Private and writable, so strings can be terminated in place
+        // without touching the file
+        void *text = mmap(NULL, info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if (text == MAP_FAILED) {
+            close(fd);
+            return false;
+        }
+        reader->text = text;
+        reader->length = info.st_size;
+    }
+    close(fd);
+    return true;
+}
+
+// Returns the next character, or EOF
+static int next(Reader *reader) {
+    if (reader->stream != NULL) {
+        return fgetc(reader->stream);
+    }
+    if (reader->position < reader->length) {
+        return (unsigned char) reader->text[reader->position++];
+    }
+    return EOF;
+}
+
+// Puts back the character next just returned
+static void back(Reader *reader, int c) {
+    if (reader->stream != NULL) {
+        ungetc(c, reader->stream);
+    } else if (c != EOF) {
+        reader->position--;
+    }
+}
+
+// Returns the next character that isn't whitespace or part of a comment
+static int skipSpace(Reader *reader) {
+    if (reader->stream == NULL) {
+        char *text = reader->text;
+        size_t i = reader->position;
+        while (i < reader->length) {
+            char c = text[i];
+            if (c == ';') {
+                char *end = memchr(text + i, '\n', reader->length - i);
+                i = end == NULL ? reader->length : (size_t) (end - text);
+            } else if (c == ' ' || c == '\n' || c == '\t') {
+                i += scanSpace(text + i, reader->length - i);
+            } else {
+                reader->position = i + 1;
+                return (unsigned char) c;
+            }
+        }
+        reader->position = i;
+        return EOF;
+    }
+    int c = fgetc(reader->stream);
+    while (c != EOF) {
+        if (c == ';') {
+            while (c != '\n' && c != EOF) {
+                c = fgetc(reader->stream);
+            }
+        } else if (!isDelim(c) || c == '"' || c == '#' || c == '(' || c == ')' || c == '['
+                || c == ']') {
+            return c;
+        } else {
+            c = fgetc(reader->stream);
+        }
+    }
+    return c;
+}
+
+// Reads a symbol or number, starting with the given character
+static Value *readSymbolOrNumber(int c, Reader *reader) {
+    char buffer[STR_LEN + 1];
+    char *token = buffer;
+    size_t length = 0;
+    if (reader->stream == NULL) {
+        // Scan the mapped text where it lies
+        token = reader->text + reader->position - 1;
+        size_t limit = reader->length - reader->position + 1;
+        length = scanToken(token, limit < STR_LEN ? limit : STR_LEN);
+        reader->position += length - 1;
+    } else {
+        while (length < STR_LEN && c != EOF && !isDelim(c)) {
+            buffer[length++] = c;
+            c = fgetc(reader->stream);
+        }
+        ungetc(c, reader->stream);
+    }
+    if (length >= STR_LEN) {
+        printf("Error (readSymbolOrNumber): token too long.");
+        texit(1);
+    }
+    return symbolOrNumber(token, length);
+}
+
+// Reads a string, after its opening quote
+static Value *readString(Reader *reader) {
+    Value *string = newValue(STR_TYPE);
+    if (reader->stream == NULL) {
+        // Point into the mapped text, ending the string where its closing
+        // quote was
+        char *text = reader->text + reader->position;
+        size_t available = reader->length - reader->position;
+        char *end = memchr(text, '"', available < STR_LEN ? available : STR_LEN);
+        if (end == NULL) {
+            if (available >= STR_LEN) {
+                printf("Error: string too long. Missing closing quote?\n");
+            } else {
+                printf("Error: EOF while reading string. Missing closing quote?\n");
+            }
+            texit(1);
+        }
+        *end = '\0';
+        reader->position += end - text + 1;
+        string->s = text;
+        return string;
+    }
+    char text[STR_LEN + 1];
+    int length = 0;
+    int c = fgetc(reader->stream);
+    while (length < STR_LEN && c != EOF && c != '"') {
+        text[length++] = c;
+        c = fgetc(reader->stream);
+    }
+    if (length >= STR_LEN) {
+        printf("Error: string too long. Missing closing quote?\n");
+        texit(1);
+    }
+    if (c == EOF) {
+        printf("Error: EOF while reading string. Missing closing quote?\n");
+        texit(1);
+    }
+    string->s = talloc(length + 1);
+    memcpy(string->s, text, length);
+    string->s[length] = '\0';
+    return string;
+}
+
+// Reads a boolean, after its #
+static Value *readBoolean(Reader *reader) {
+    int c = next(reader);
+    bool value = false;
+    if (c == 't' || c == 'T') {
+        value = true;
+    } else if (c != 'f' && c != 'F') {
+        printf("Error (readBoolean): boolean was not #t or #f\n");
+        texit(1);
+    }
+    c = next(reader);
+    if (!isDelim(c)) {
+        printf("Error (readBoolean): boolean was not #t or #f followed by delim\n");
+        texit(1);
+    }
+    back(reader, c);
+    return makeBool(value);
+}
+
+// Reads the datum starting with the given character. Returns NULL at the end
+// of the input, and a CLOSE_TYPE for a close paren, which only means anything
+// inside a list.
+static Value *readWith(int c, Reader *reader);
+
+// Reads the rest of a list, after its open paren
+static Value *readList(Reader *reader) {
+    Value *items = makeEmptyList();
+    while (true) {
+        Value *item = readWith(skipSpace(reader), reader);
+        if (item == NULL) {
+            printf("Syntax error: not enough close parentheses.\n");
+            texit(1);
+        }
+        if (item->type == CLOSE_TYPE) {
+            return reverse(items);
+        }
+        items = cons(item, items);
+    }
+}
+
+static Value *readWith(int c, Reader *reader) {
+    static Value close = {CLOSE_TYPE};
+    switch (c) {
+        case EOF:
+            return NULL;
+        case '(':
+        case '[':
+            return readList(reader);
+        case ')':
+        case ']':
+            return &close;
+        case '"':
+            return readString(reader);
+        case '#':
+            return readBoolean(reader);
+        default:
+            return readSymbolOrNumber(c, reader);
+    }
+}
+
+Value *readDatum(Reader *reader) {
+    Value *datum = readWith(skipSpace(reader), reader);
+    if (datum != NULL && datum->type == CLOSE_TYPE) {
+        printf("Syntax error: too many close parentheses.\n");
+        texit(1);
+    }
+    return datum;
+}
@@ -0,0 +1,34 @@
+#include <stdio.h>
+#include <stddef.h>
+#include "value.h"
+
+#ifndef _READER
+#define _READER
+
+// Where readDatum reads from: either a stream, read a character at a time, or
+// the text of a whole file, mapped into memory and scanned in place.
+typedef struct Reader {
+    FILE *stream;
+    char *text;
+    size_t length;
+    size_t position;
+} Reader;
+
+// Sets up a reader for a stream such as stdin
+void openStream(Reader *reader, FILE *stream);
+
+// Sets up a reader for the file at the given path by mapping it into memory.
+// Returns false, with errno set, if the file can't be opened or mapped. The
+// mapping is kept for as long as the program runs, since the strings read
+// from it point into it.
+bool openFile(Reader *reader, char *path);
+
+// Reads the next datum: a number, string, boolean, symbol or parenthesized
+// list, with symbols already interned. Returns NULL at the end of the input.
+// Only reads as much as the datum takes, so each expression can be evaluated
+// before the next one is read.
+//
+// Integers are read to their full 64 bits.
+Value *readDatum(Reader *reader);
+
+#endif
@@ -0,0 +1,217 @@
+// resolve.c
+
+// The resolution pass. Scoping in our Racket subset is static, so the frame
+// and slot every local variable reference will find at run time is known
+// before the code runs. resolve works it out once per top-level expression,
+// so that eval never has to search frames for a name.
+
+#include "value.h"
+#include "linkedlist.h"
+#include "talloc.h"
+#include "symbol.h"
+#include "resolve.h"
+
+// The names bound by one frame while it is being resolved. Names are kept
+// most recently added first, so the slot of the name at position i in the
+// list is count - 1 - i. Only the first `visible` slots can be referred to,
+// which is how each binding of a let* only sees the ones before it.
+typedef struct Environment {
+    Value *names;
+    int count;
+    int visible;
+    struct Environment *parent;
+} Environment;
+
+static Value *resolveExpr(Value *expr, Environment *env);
+
+// Returns true if the value is a proper list of symbols
+static bool isSymbolList(Value *list) {
+    while (list->type == CONS_TYPE) {
+        if (car(list)->type != SYMBOL_TYPE) {
+            return false;
+        }
+        list = cdr(list);
+    }
+    return list->type == NULL_TYPE;
+}
+
+// Returns true if the value is a proper list of (symbol expr) lists
+static bool isBindingList(Value *list) {
+    while (list->type == CONS_TYPE) {
+        Value *pair = car(list);
+        if (pair->type != CONS_TYPE || car(pair)->type != SYMBOL_TYPE
+                || cdr(pair)->type != CONS_TYPE || cdr(cdr(pair))->type != NULL_TYPE) {
+            return false;
+        }
+        list = cdr(list);
+    }
+    return list->type == NULL_TYPE;
+}
+
+// Returns true if the given name already has a slot in the environment
+static bool isBound(Value *name, Environment *env) {
+    for (Value *names = env->names; names->type != NULL_TYPE; names = cdr(names)) {
+        if (car(names) == name) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Gives the name a new slot in the environment
+static void addName(Value *name, Environment *env) {
+    env->names = cons(name, env->names);
+    env->count++;
+}
+
+// Finds every define that will add a binding to the frame being resolved,
+// without looking inside forms that create frames of their own, and gives
+// each defined name a slot.
+static void collectDefines(Value *expr, Environment *env) {
+    if (expr->type != CONS_TYPE) {
+        return;
+    }
+    Value *head = car(expr);
+    if (head == quoteSymbol || head == tickSymbol || head == lambdaSymbol
+            || head == letStarSymbol || head == letRecSymbol) {
+        return;
+    }
+    if (head == letSymbol) {
+        // Only the bindings of a let are evaluated in this frame
+        if (cdr(expr)->type == CONS_TYPE) {
+            collectDefines(car(cdr(expr)), env);
+        }
+        return;
+    }
+    if (head == defineSymbol && length(expr) == 3) {
+        Value *name = car(cdr(expr));
+        if (name->type == SYMBOL_TYPE && !isBound(name, env)) {
+            addName(name, env);
+        }
+    }
+    for (Value *current = expr; current->type == CONS_TYPE; current = cdr(current)) {
+        collectDefines(car(current), env);
+    }
+}
+
+// Returns the LOCAL_TYPE for the slot a symbol refers to, or the symbol itself
+// if it isn't bound by any enclosing frame
+static Value *lookUp(Value *symbol, Environment *env) {
+    for (int depth = 0; env != NULL; env = env->parent, depth++) {
+        int slot = env->count - 1;
+        for (Value *names = env->names; names->type != NULL_TYPE; names = cdr(names), slot--) {
+            if (slot < env->visible && car(names) == symbol) {
+                Value *local = newValue(LOCAL_TYPE);
+                local->local.depth = depth;
+                local->local.slot = slot;
+                local->local.symbol = symbol;
+                return local;
+            }
+        }
+    }
+    return symbol;
+}
+
+// Resolves every element of a list in place
+static void resolveEach(Value *list, Environment *env) {
+    for (Value *current = list; current->type == CONS_TYPE; current = cdr(current)) {
+        current->c.car = resolveExpr(car(current), env);
+    }
+}
+
+// Builds the SCOPE_TYPE for a fully resolved environment, and inserts it as
+// the first argument of the form that creates the frame
+static void addScope(Value *expr, Environment *env, int params) {
+    Value *scope = newValue(SCOPE_TYPE);
+    scope->scope.names = reverse(env->names);
+    scope->scope.params = params;
+    scope->scope.size = env->count;
+    scope->scope.code = NULL;
+    expr->c.cdr = cons(scope, cdr(expr));
+}
+
+// Resolves (lambda (params...) body)
+static void resolveLambda(Value *expr, Environment *env) {
+    Value *args = cdr(expr);
+    if (length(args) != 2 || !isSymbolList(car(args))) {
+        return;
+    }
+    Environment inner = {makeNull(), 0, 0, env};
+    for (Value *params = car(args); params->type != NULL_TYPE; params = cdr(params)) {
+        addName(car(params), &inner);
+    }
+    int params = inner.count;
+    collectDefines(car(cdr(args)), &inner);
+    inner.visible = inner.count;
+    resolveEach(cdr(args), &inner);
+    addScope(expr, &inner, params);
+}
+
+// Resolves (let ((name expr)...) body), and likewise let* and letrec. The
+// bindings of a let are evaluated in the enclosing frame; those of let* and
+// letrec are evaluated in the new frame, one after another.
+static void resolveLet(Value *expr, Environment *env) {
+    Value *head = car(expr);
+    Value *args = cdr(expr);
+    if (length(args) != 2 || !isBindingList(car(args))) {
+        return;
+    }
+    Environment inner = {makeNull(), 0, 0, env};
+    for (Value *bindings = car(args); bindings->type != NULL_TYPE; bindings = cdr(bindings)) {
+        Value *binding = car(bindings);
+        if (head == letSymbol) {
+            resolveEach(cdr(binding), env);
+        } else if (head == letStarSymbol) {
+            resolveEach(cdr(binding), &inner);
+        }
+        addName(car(binding), &inner);
+        inner.visible = inner.count;
+    }
+    int params = inner.count;
+    if (head == letRecSymbol) {
+        for (Value *bindings = car(args); bindings->type != NULL_TYPE; bindings = cdr(bindings)) {
+            resolveEach(cdr(car(bindings)), &inner);
+        }
+    }
+    collectDefines(car(cdr(args)), &inner);
+    inner.visible = inner.count;
+    resolveEach(cdr(args), &inner);
+    addScope(expr, &inner, params);
+}
+
+// Resolves one expression, returning what should replace it
+static Value *resolveExpr(Value *expr, Environment *env) {
+    if (expr->type == SYMBOL_TYPE) {
+        return lookUp(expr, env);
+    }
+    if (expr->type != CONS_TYPE) {
+        return expr;
+    }
+    Value *head = car(expr);
+    if (head->type != SYMBOL_TYPE) {
+        // eval returns a list that doesn't start with a symbol as it is, so
+        // it is data and must be left as it was written
+    } else if (!isSpecialForm(head)) {
+        resolveEach(expr, env);
+    } else if (cdr(expr)->type == CONS_TYPE && car(cdr(expr))->type == SCOPE_TYPE) {
+        // Already resolved
+    } else if (head == lambdaSymbol) {
+        resolveLambda(expr, env);
+    } else if (head == letSymbol || head == letStarSymbol || head == letRecSymbol) {
+        resolveLet(expr, env);
+    } else if (head == condSymbol) {
+        for (Value *clauses = cdr(expr); clauses->type == CONS_TYPE; clauses = cdr(clauses)) {
+            Value *clause = car(clauses);
+            if (clause->type == CONS_TYPE) {
+                resolveEach(car(clause) == elseSymbol ? cdr(clause) : clause, env);
+            }
+        }
+    } else if (head != quoteSymbol && head != tickSymbol) {
+        resolveEach(cdr(expr), env);
+    }
+    return expr;
+}
+
+Value *resolve(Value *expr) {
+    return resolveExpr(expr, NULL);
+}
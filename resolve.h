@@ -0,0 +1,20 @@
+#include "value.h"
+
+#ifndef _RESOLVE
+#define _RESOLVE
+
+// Resolves a top-level expression in place before it is evaluated. Every
+// variable reference inside a lambda, let, let* or letrec that names one of
+// their parameters, bindings or internal defines is replaced by a LOCAL_TYPE
+// giving the frame depth and slot it lives in, and every well-formed binding
+// form gets a SCOPE_TYPE describing its frame inserted as its first argument:
+//
+//     (lambda <scope> (params...) body)
+//     (let <scope> ((name expr)...) body)
+//
+// References that aren't bound by any enclosing form stay symbols and are
+// looked up in the top-level frame. Quoted data is left alone, and so are
+// malformed binding forms, so that evaluating them still raises an error.
+Value *resolve(Value *expr);
+
+#endif
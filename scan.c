@@ -0,0 +1,176 @@
+// scan.c
+
+// The character-level scanning the reader is built on. Runs
+// of ordinary characters and of whitespace are skipped a vector at a time
+// where the compiler targets SSE2 or AVX2, which every x86-64 machine has at
+// least the first of, and a byte at a time elsewhere and at the ends of the
+// text. Numbers are converted by hand rather than with atoi and atof.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+#include "value.h"
+#include "symbol.h"
+#include "scan.h"
+
+bool isDelim(int c) {
+    switch (c) {
+        case '\t':
+        case '\n':
+        case ' ':
+        case '"':
+        case '#':
+        case '(':
+        case ')':
+        case ';':
+        case '[':
+        case ']':
+            return true;
+        default:
+            return false;
+    }
+}
+
+static bool isSpace(char c) {
+    return c == ' ' || c == '\n' || c == '\t';
+}
+
+#if defined(__AVX2__)
+
+#define VECTOR 32
+typedef __m256i vector;
+#define load(p) _mm256_loadu_si256((const __m256i *) (p))
+#define equal(v, c) _mm256_cmpeq_epi8(v, _mm256_set1_epi8(c))
+#define either(a, b) _mm256_or_si256(a, b)
+#define mask(v) ((uint32_t) _mm256_movemask_epi8(v))
+
+#elif defined(__SSE2__)
+
+#define VECTOR 16
+typedef __m128i vector;
+#define load(p) _mm_loadu_si128((const __m128i *) (p))
+#define equal(v, c) _mm_cmpeq_epi8(v, _mm_set1_epi8(c))
+#define either(a, b) _mm_or_si128(a, b)
+#define mask(v) ((uint32_t) _mm_movemask_epi8(v))
+
+#endif
+
+#ifdef VECTOR
+
+// Returns a bit for each of the characters that is a space, tab or newline
+static uint32_t spaces(vector v) {
+    return mask(either(either(equal(v, ' '), equal(v, '\n')), equal(v, '\t')));
+}
+
+// Returns a bit for each of the characters that is a delimiter
+static uint32_t delimiters(vector v) {
+    vector brackets = either(either(equal(v, '('), equal(v, ')')), either(equal(v, '['), equal(v, ']')));
+    vector others = either(either(equal(v, '"'), equal(v, '#')), equal(v, ';'));
+    return spaces(v) | mask(either(brackets, others));
+}
+
+#endif
+
+size_t scanToken(char *text, size_t length) {
+    size_t i = 0;
+#ifdef VECTOR
+    for (; i + VECTOR <= length; i += VECTOR) {
+        uint32_t found = delimiters(load(text + i));
+        if (found != 0) {
+            return i + __builtin_ctz(found);
+        }
+    }
+#endif
+    while (i < length && !isDelim(text[i])) {
+        i++;
+    }
+    return i;
+}
+
+size_t scanSpace(char *text, size_t length) {
+    size_t i = 0;
+#ifdef VECTOR
+    for (; i + VECTOR <= length; i += VECTOR) {
+        uint32_t other = ~spaces(load(text + i));
+#if VECTOR == 16
+        other &= 0xffff;
+#endif
+        if (other != 0) {
+            return i + __builtin_ctz(other);
+        }
+    }
+#endif
+    while (i < length && isSpace(text[i])) {
+        i++;
+    }
+    return i;
+}
+
+// Powers of ten that doubles hold exactly
+static const double powersOfTen[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+    1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+// Converts a number with strtod, for the ones the fast paths can't do exactly
+static Value *slowDouble(char *token, size_t length) {
+    char number[STR_LEN + 1];
+    memcpy(number, token, length);
+    number[length] = '\0';
+    return makeDouble(strtod(number, NULL));
+}
+
+Value *symbolOrNumber(char *token, size_t length) {
+    size_t i = 0;
+    bool negative = false;
+    if (length > 0 && (token[0] == '+' || token[0] == '-')) {
+        negative = token[0] == '-';
+        i++;
+    }
+
+    // Accumulate the digits, noting where the point is and whether they still
+    // fit in 64 bits
+    uint64_t digits = 0;
+    int count = 0;
+    int fraction = -1;
+    bool overflow = false;
+    for (; i < length; i++) {
+        char c = token[i];
+        if (c >= '0' && c <= '9') {
+            if (digits > (UINT64_MAX - 9) / 10) {
+                overflow = true;
+            } else {
+                digits = digits * 10 + (c - '0');
+            }
+            count++;
+            if (fraction >= 0) {
+                fraction++;
+            }
+        } else if (c == '.' && fraction < 0) {
+            fraction = 0;
+        } else {
+            return internCopy(token, length);
+        }
+    }
+    if (count == 0) {
+        return internCopy(token, length);
+    }
+
+    if (fraction < 0) {
+        uint64_t limit = negative ? (uint64_t) INT64_MAX + 1 : INT64_MAX;
+        if (overflow || digits > limit) {
+            // Too big for an integer, so it can only be approximated
+            return slowDouble(token, length);
+        }
+        return makeInt(negative ? (int64_t) (0 - digits) : (int64_t) digits);
+    }
+
+    // Both the digits and the power of ten are exact as doubles, so their
+    // quotient is correctly rounded
+    if (!overflow && digits <= (1ULL << 53) && fraction <= 22) {
+        double d = (double) digits / powersOfTen[fraction];
+        return makeDouble(negative ? -d : d);
+    }
+    return slowDouble(token, length);
+}
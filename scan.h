@@ -0,0 +1,28 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include "value.h"
+
+#ifndef _SCAN
+#define _SCAN
+
+// The longest symbol, number or string the reader accepts
+#define STR_LEN 300
+
+// Returns true for the characters that end a symbol or number
+bool isDelim(int c);
+
+// Returns the number of characters at the start of the text, up to length,
+// that aren't delimiters: the length of the symbol or number there.
+size_t scanToken(char *text, size_t length);
+
+// Returns the number of spaces, tabs and newlines at the start of the text,
+// up to length.
+size_t scanSpace(char *text, size_t length);
+
+// Makes the symbol or number spelled by the given characters, which needn't
+// be NUL-terminated. A number is digits with at most one decimal point and at
+// most one sign, which must come first; integers too big for 64 bits are read
+// as doubles. Anything else is returned as an interned symbol.
+Value *symbolOrNumber(char *token, size_t length);
+
+#endif
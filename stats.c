@@ -0,0 +1,68 @@
+// stats.c
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "value.h"
+#include "linkedlist.h"
+#include "talloc.h"
+#include "symbol.h"
+#include "interpreter.h"
+#include "stats.h"
+
+// The names values are counted under, in valueType order
+static char *typeNames[VALUE_TYPES] = {"int", "double", "string", "cons", "null", "pointer",
+    "open", "close", "bool", "symbol", "closure", "void", "primitive", "local", "scope",
+    "vector", "hash"};
+
+static Value *entry(char *name, Value *value) {
+    return cons(intern(name), value);
+}
+
+static Value *count(size_t n) {
+    return makeInt((int64_t) n);
+}
+
+Value *primitiveMemoryStats(Value *args) {
+    if (args->type != NULL_TYPE) {
+        evaluationError();
+    }
+    AllocationStats stats = allocationStats();
+    Value *values = makeNull();
+    for (int type = VALUE_TYPES - 1; type >= 0; type--) {
+        values = cons(entry(typeNames[type], count(valuesMade(type))), values);
+    }
+    Value *list = makeNull();
+    list = cons(entry("values", values), list);
+    list = cons(entry("collection-seconds", makeDouble(stats.collectionSeconds)), list);
+    list = cons(entry("allocation-seconds", makeDouble(stats.allocationSeconds)), list);
+    list = cons(entry("collections", count(stats.collections)), list);
+    list = cons(entry("peak-heap-bytes", count(stats.peakHeapBytes)), list);
+    list = cons(entry("heap-bytes", count(stats.heapBytes)), list);
+    list = cons(entry("bytes-allocated", count(stats.bytesAllocated)), list);
+    list = cons(entry("bytes-requested", count(stats.bytesRequested)), list);
+    list = cons(entry("allocations", count(stats.allocations)), list);
+    list = cons(entry("frames", count(framesMade())), list);
+    return list;
+}
+
+// Runs after tfree, so only reports totals, which tfree leaves alone
+static void printStats() {
+    AllocationStats stats = allocationStats();
+    fprintf(stderr, "[stats] %zu allocations, %zu bytes requested, %zu bytes allocated, "
+            "peak heap %zu bytes\n", stats.allocations, stats.bytesRequested,
+            stats.bytesAllocated, stats.peakHeapBytes);
+    fprintf(stderr, "[stats] %.3f ms allocating, %d collections taking %.3f ms\n",
+            1000 * stats.allocationSeconds, stats.collections, 1000 * stats.collectionSeconds);
+    fprintf(stderr, "[stats] %zu frames, values:", framesMade());
+    for (int type = 0; type < VALUE_TYPES; type++) {
+        if (valuesMade(type) > 0) {
+            fprintf(stderr, " %s %zu", typeNames[type], valuesMade(type));
+        }
+    }
+    fprintf(stderr, "\n");
+}
+
+void startStats() {
+    timeAllocations(true);
+    atexit(printStats);
+}
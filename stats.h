@@ -0,0 +1,17 @@
+#include "value.h"
+
+#ifndef _STATS
+#define _STATS
+
+// Memory telemetry: how many values of each type have been made, how many
+// frames, and what talloc has done (see talloc.h), as a primitive the program
+// can call and as a summary printed at exit.
+
+// (memory-stats): an association list of (name . number) pairs, with the
+// counts of values made by type in a nested list under values
+Value *primitiveMemoryStats(Value *args);
+
+// Starts timing allocations and prints the summary to stderr at exit
+void startStats();
+
+#endif
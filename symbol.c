@@ -0,0 +1,145 @@
+// symbol.c
+
+// The symbol table. Every symbol read by the reader or bound by the
+// interpreter is looked up here by name, so that each name has exactly one
+// SYMBOL_TYPE Value and lookups in frames can compare pointers.
+
+#include <string.h>
+#include "value.h"
+#include "talloc.h"
+#include "symbol.h"
+
+// Open addressing hash table of canonical symbols, keyed by name. The table
+// is talloced, and reachable from this global, so the collector keeps every
+// interned symbol alive.
+static Value **symbols = NULL;
+static size_t capacity = 0;
+static size_t count = 0;
+
+// FNV-1a hash of a symbol name, which is the given number of characters long
+static size_t hashName(char *name, size_t length) {
+    size_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ (unsigned char) name[i]) * 16777619u;
+    }
+    return hash;
+}
+
+// Returns the slot holding the symbol with the given name, or the empty slot
+// where it belongs. The name doesn't need to be NUL-terminated.
+static Value **findSlot(char *name, size_t length) {
+    size_t index = hashName(name, length) & (capacity - 1);
+    while (symbols[index] != NULL && (strncmp(symbols[index]->s, name, length)
+            || symbols[index]->s[length] != '\0')) {
+        index = (index + 1) & (capacity - 1);
+    }
+    return &symbols[index];
+}
+
+// Doubles the size of the table, rehashing every symbol
+static void grow() {
+    Value **old = symbols;
+    size_t oldCapacity = capacity;
+    capacity = capacity ? capacity * 2 : 256;
+    symbols = talloc(capacity * sizeof(Value *));
+    memset(symbols, 0, capacity * sizeof(Value *));
+    for (size_t i = 0; i < oldCapacity; i++) {
+        if (old[i] != NULL) {
+            *findSlot(old[i]->s, strlen(old[i]->s)) = old[i];
+        }
+    }
+}
+
+// Returns the canonical symbol with the same name as the given one, making
+// the given symbol canonical if there is none yet
+static Value *internSymbol(Value *symbol) {
+    if (2 * (count + 1) > capacity) {
+        grow();
+    }
+    Value **slot = findSlot(symbol->s, strlen(symbol->s));
+    if (*slot == NULL) {
+        symbol->sym.form = NO_FORM;
+        symbol->sym.foldable = false;
+        symbol->sym.version = 0;
+        symbol->sym.pair = NULL;
+        *slot = symbol;
+        count++;
+    }
+    return *slot;
+}
+
+Value *intern(char *name) {
+    if (capacity > 0) {
+        Value *found = *findSlot(name, strlen(name));
+        if (found != NULL) {
+            return found;
+        }
+    }
+    Value *symbol = newValue(SYMBOL_TYPE);
+    symbol->s = name;
+    return internSymbol(symbol);
+}
+
+Value *internCopy(char *name, size_t length) {
+    if (capacity > 0) {
+        Value *found = *findSlot(name, length);
+        if (found != NULL) {
+            return found;
+        }
+    }
+    char *copy = talloc(length + 1);
+    memcpy(copy, name, length);
+    copy[length] = '\0';
+    return intern(copy);
+}
+
+Value *ifSymbol;
+Value *condSymbol;
+Value *elseSymbol;
+Value *letSymbol;
+Value *letStarSymbol;
+Value *letRecSymbol;
+Value *setBangSymbol;
+Value *quoteSymbol;
+Value *tickSymbol;
+Value *lambdaSymbol;
+Value *defineSymbol;
+Value *andSymbol;
+Value *orSymbol;
+Value *beginSymbol;
+Value *foldedSymbol;
+
+// Interns a special form's name and tags its symbol
+static Value *internForm(char *name, specialForm form) {
+    Value *symbol = intern(name);
+    symbol->sym.form = form;
+    return symbol;
+}
+
+void internSpecialForms() {
+    ifSymbol = internForm("if", IF_FORM);
+    condSymbol = internForm("cond", COND_FORM);
+    elseSymbol = intern("else");
+    letSymbol = internForm("let", LET_FORM);
+    letStarSymbol = internForm("let*", LET_STAR_FORM);
+    letRecSymbol = internForm("letrec", LETREC_FORM);
+    setBangSymbol = internForm("set!", SET_BANG_FORM);
+    quoteSymbol = internForm("quote", QUOTE_FORM);
+    tickSymbol = internForm("\'", QUOTE_FORM);
+    lambdaSymbol = internForm("lambda", LAMBDA_FORM);
+    defineSymbol = internForm("define", DEFINE_FORM);
+    andSymbol = internForm("and", AND_FORM);
+    orSymbol = internForm("or", OR_FORM);
+    beginSymbol = internForm("begin", BEGIN_FORM);
+
+    foldedSymbol = newValue(SYMBOL_TYPE);
+    foldedSymbol->s = "folded";
+    foldedSymbol->sym.form = FOLDED_FORM;
+    foldedSymbol->sym.foldable = false;
+    foldedSymbol->sym.version = 0;
+    foldedSymbol->sym.pair = NULL;
+}
+
+bool isSpecialForm(Value *value) {
+    return value->type == SYMBOL_TYPE && value->sym.form != NO_FORM;
+}
@@ -0,0 +1,53 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include "value.h"
+
+#ifndef _SYMBOL
+#define _SYMBOL
+
+// The special forms, as tagged on their interned symbols. Every other symbol
+// is tagged NO_FORM. FOLDED_FORM is only ever made by the folding pass.
+typedef enum {NO_FORM, IF_FORM, COND_FORM, LET_FORM, LET_STAR_FORM, LETREC_FORM, SET_BANG_FORM,
+    QUOTE_FORM, LAMBDA_FORM, DEFINE_FORM, AND_FORM, OR_FORM, BEGIN_FORM, FOLDED_FORM,
+    SPECIAL_FORMS} specialForm;
+
+// Returns the canonical SYMBOL_TYPE Value with the given name. There is only
+// ever one symbol per name, so symbols can be compared by address instead of
+// with strcmp.
+Value *intern(char *name);
+
+// Returns the canonical symbol for the name made of the given number of
+// characters, which needn't be NUL-terminated or kept. The name is copied
+// only if it hasn't been seen before.
+Value *internCopy(char *name, size_t length);
+
+// Interned symbols for the special forms and the other names the evaluator
+// and the resolver recognise. They are set by internSpecialForms.
+extern Value *ifSymbol;
+extern Value *condSymbol;
+extern Value *elseSymbol;
+extern Value *letSymbol;
+extern Value *letStarSymbol;
+extern Value *letRecSymbol;
+extern Value *setBangSymbol;
+extern Value *quoteSymbol;
+extern Value *tickSymbol;
+extern Value *lambdaSymbol;
+extern Value *defineSymbol;
+extern Value *andSymbol;
+extern Value *orSymbol;
+extern Value *beginSymbol;
+
+// The head of (folded <version> replacement original), which the folding
+// pass puts where it has folded an expression (see fold.h). The symbol isn't
+// interned, so no program can write the form itself.
+extern Value *foldedSymbol;
+
+// Looks up the symbols above in the symbol table, and tags the special forms
+void internSpecialForms();
+
+// Returns true if the given value is the name of a special form. Special
+// forms can't be shadowed, so this doesn't depend on any frame.
+bool isSpecialForm(Value *value);
+
+#endif
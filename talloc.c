@@ -0,0 +1,490 @@
+// talloc.c
+
+// A garbage collected replacement for malloc. Small blocks (every Value, cons
+// cell, Frame and most strings) are carved out of large chunks, one size
+// class per chunk: a fresh chunk is handed out with a bump pointer, and cells
+// freed by the collector are reused through a per-class free list. Blocks
+// too large for any size class get their own malloc with a header and are
+// tracked in a table. Once enough bytes have been allocated since the last
+// collection, the next call to talloc runs a mark-sweep collection before
+// allocating.
+//
+// The collector is conservative: it does not know the layout of the blocks it
+// manages. Roots are every pointer-sized word on the C stack (including the
+// callee-saved registers, which are spilled onto the stack first) and in the
+// program's data and bss segments. Any word that points into a talloced block
+// keeps that block alive, and the contents of every live block are scanned
+// the same way. This means Frames, bindings and Values reachable from eval's
+// locals, from interpret's top-level frame or from any global survive, and
+// everything else is freed.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "talloc.h"
+#include "trace.h"
+#include "output.h"
+
+// Start of the data segment and end of the bss segment, provided by the
+// linker, and the address of the bottom of the main thread's stack, provided
+// by glibc.
+extern char __data_start[];
+extern char _end[];
+extern void *__libc_stack_end;
+
+#define DEFAULT_THRESHOLD (4 * 1024 * 1024)
+
+// Chunks are CHUNK_SIZE bytes and aligned to CHUNK_SIZE, so the chunk holding
+// any small block is found by masking off the low bits of its address.
+#define CHUNK_SIZE (64 * 1024)
+#define GRANULE 8
+#define SIZE_CLASSES 32
+#define MAX_SMALL_SIZE (GRANULE * SIZE_CLASSES)
+#define MAX_CELLS (CHUNK_SIZE / GRANULE)
+#define BITMAP_WORDS (MAX_CELLS / 32)
+
+typedef struct Chunk {
+    size_t cellSize;
+    size_t cellCount;
+    // Number of cells handed out by the bump pointer so far
+    size_t used;
+    char *cells;
+    uint32_t allocated[BITMAP_WORDS];
+    uint32_t marked[BITMAP_WORDS];
+} Chunk;
+
+// Large blocks are preceded by a header. The union keeps the payload aligned
+// for doubles.
+typedef union Header {
+    struct {
+        size_t size;
+        int marked;
+    };
+    long double align;
+} Header;
+
+// A block waiting to have its contents scanned
+typedef struct Grey {
+    char *start;
+    size_t size;
+} Grey;
+
+// Every chunk, sorted by address
+static Chunk **chunks = NULL;
+static size_t chunkCount = 0;
+static size_t chunkCapacity = 0;
+
+// Chunk currently being bump allocated from, and the head of the free list,
+// for each size class. A free cell holds the address of the next free cell.
+static Chunk *current[SIZE_CLASSES];
+static void *freeLists[SIZE_CLASSES];
+
+// Every large block, sorted by address during a collection so that candidate
+// pointers can be found with a binary search.
+static Header **objects = NULL;
+static size_t objectCount = 0;
+static size_t objectCapacity = 0;
+
+// Explicit stack used while marking so that long lists don't recurse.
+static Grey *markStack = NULL;
+static size_t markCount = 0;
+static size_t markCapacity = 0;
+
+static size_t threshold = DEFAULT_THRESHOLD;
+static size_t minimumThreshold = DEFAULT_THRESHOLD;
+static size_t allocatedSinceCollection = 0;
+static size_t totalAllocated = 0;
+static size_t allocations = 0;
+static size_t bytesRequested = 0;
+static bool timing = false;
+static double allocationSeconds = 0;
+static double collectionSeconds = 0;
+static size_t heapBytes = 0;
+static size_t peakHeapBytes = 0;
+static int collections = 0;
+static bool reporting = false;
+static void (*collectionHook)() = NULL;
+
+static double seconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+// Exits with an error message on stderr if malloc fails. What the program has
+// printed so far is flushed first, so the message comes after it.
+static void outOfMemory() {
+    flushOutput();
+    fprintf(stderr, "Error (talloc): malloc failed to allocate memory\n");
+    exit(1);
+}
+
+// Doubles the capacity of a table, which must then hold at least one more entry
+static void *growTable(void *table, size_t *capacity, size_t entrySize) {
+    *capacity = *capacity ? *capacity * 2 : 1024;
+    void *grown = realloc(table, *capacity * entrySize);
+    if (grown == NULL) {
+        outOfMemory();
+    }
+    return grown;
+}
+
+static int compareHeaders(const void *a, const void *b) {
+    uintptr_t first = (uintptr_t) *(Header **) a;
+    uintptr_t second = (uintptr_t) *(Header **) b;
+    return (first > second) - (first < second);
+}
+
+// Returns the chunk starting at the given address, or NULL if there is none
+static Chunk *findChunk(uintptr_t base) {
+    size_t low = 0;
+    size_t high = chunkCount;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (base < (uintptr_t) chunks[middle]) {
+            high = middle;
+        } else if (base > (uintptr_t) chunks[middle]) {
+            low = middle + 1;
+        } else {
+            return chunks[middle];
+        }
+    }
+    return NULL;
+}
+
+// Allocates a new chunk for the given size class and adds it to the chunk table
+static Chunk *newChunk(int sizeClass) {
+    Chunk *chunk = aligned_alloc(CHUNK_SIZE, CHUNK_SIZE);
+    if (chunk == NULL) {
+        outOfMemory();
+    }
+    size_t headerSize = (sizeof(Chunk) + 15) & ~(size_t) 15;
+    chunk->cellSize = (sizeClass + 1) * GRANULE;
+    chunk->cellCount = (CHUNK_SIZE - headerSize) / chunk->cellSize;
+    chunk->used = 0;
+    chunk->cells = (char *) chunk + headerSize;
+    memset(chunk->allocated, 0, sizeof(chunk->allocated));
+    memset(chunk->marked, 0, sizeof(chunk->marked));
+
+    if (chunkCount == chunkCapacity) {
+        chunks = growTable(chunks, &chunkCapacity, sizeof(Chunk *));
+    }
+    size_t position = chunkCount;
+    while (position > 0 && (uintptr_t) chunks[position - 1] > (uintptr_t) chunk) {
+        chunks[position] = chunks[position - 1];
+        position--;
+    }
+    chunks[position] = chunk;
+    chunkCount++;
+    return chunk;
+}
+
+// Pushes a block onto the mark stack
+static void grey(char *start, size_t size) {
+    if (markCount == markCapacity) {
+        markStack = growTable(markStack, &markCapacity, sizeof(Grey));
+    }
+    markStack[markCount].start = start;
+    markStack[markCount].size = size;
+    markCount++;
+}
+
+// Marks the block containing the given address, if there is one. Interior
+// pointers count, since an optimising compiler may only keep a pointer to a
+// field alive.
+static void markAddress(uintptr_t address) {
+    Chunk *chunk = findChunk(address & ~(uintptr_t) (CHUNK_SIZE - 1));
+    if (chunk != NULL) {
+        if (address < (uintptr_t) chunk->cells) {
+            return;
+        }
+        size_t index = (address - (uintptr_t) chunk->cells) / chunk->cellSize;
+        uint32_t bit = 1u << (index % 32);
+        if (index >= chunk->used || !(chunk->allocated[index / 32] & bit)
+                || (chunk->marked[index / 32] & bit)) {
+            return;
+        }
+        chunk->marked[index / 32] |= bit;
+        grey(chunk->cells + index * chunk->cellSize, chunk->cellSize);
+        return;
+    }
+
+    size_t low = 0;
+    size_t high = objectCount;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        Header *header = objects[middle];
+        uintptr_t start = (uintptr_t) (header + 1);
+        if (address < start) {
+            high = middle;
+        } else if (address >= start + header->size) {
+            low = middle + 1;
+        } else {
+            if (!header->marked) {
+                header->marked = 1;
+                grey((char *) start, header->size);
+            }
+            return;
+        }
+    }
+}
+
+// Marks every block pointed to by a word in the range [start, end)
+static void markRange(void *start, void *end) {
+    uintptr_t first = ((uintptr_t) start + sizeof(void *) - 1) & ~(uintptr_t) (sizeof(void *) - 1);
+    for (uintptr_t word = first; word + sizeof(void *) <= (uintptr_t) end; word += sizeof(void *)) {
+        markAddress(*(uintptr_t *) word);
+    }
+}
+
+// Marks everything reachable from the blocks on the mark stack
+static void markReachable() {
+    while (markCount > 0) {
+        markCount--;
+        markRange(markStack[markCount].start, markStack[markCount].start + markStack[markCount].size);
+    }
+}
+
+// Marks from the stack. Kept out of line so that the registers spilled by
+// __builtin_unwind_init are below this frame's locals.
+static void __attribute__((noinline)) markStackRoots() {
+    __builtin_unwind_init();
+    void *top = &top;
+    markRange(top, __libc_stack_end);
+    markReachable();
+}
+
+// Frees every unmarked cell, releases chunks with no live cells and rebuilds
+// the free lists. Returns the number of cells freed.
+static size_t sweepChunks(size_t *freedBytes) {
+    size_t freed = 0;
+    size_t kept = 0;
+    for (int i = 0; i < SIZE_CLASSES; i++) {
+        freeLists[i] = NULL;
+    }
+    for (size_t i = 0; i < chunkCount; i++) {
+        Chunk *chunk = chunks[i];
+        int sizeClass = chunk->cellSize / GRANULE - 1;
+        size_t live = 0;
+        size_t dead = 0;
+        for (size_t word = 0; word * 32 < chunk->used; word++) {
+            dead += __builtin_popcount(chunk->allocated[word] & ~chunk->marked[word]);
+            live += __builtin_popcount(chunk->marked[word]);
+            chunk->allocated[word] = chunk->marked[word];
+            chunk->marked[word] = 0;
+        }
+        freed += dead;
+        *freedBytes += dead * chunk->cellSize;
+        heapBytes -= dead * chunk->cellSize;
+
+        if (live == 0) {
+            if (current[sizeClass] == chunk) {
+                current[sizeClass] = NULL;
+            }
+            free(chunk);
+            continue;
+        }
+        chunks[kept++] = chunk;
+        for (size_t index = chunk->used; index-- > 0;) {
+            if (!(chunk->allocated[index / 32] & (1u << (index % 32)))) {
+                void **cell = (void **) (chunk->cells + index * chunk->cellSize);
+                *cell = freeLists[sizeClass];
+                freeLists[sizeClass] = cell;
+            }
+        }
+    }
+    chunkCount = kept;
+    return freed;
+}
+
+// Frees every unmarked large block and clears the marks on the survivors
+static size_t sweepObjects(size_t *freedBytes) {
+    size_t kept = 0;
+    size_t freed = 0;
+    for (size_t i = 0; i < objectCount; i++) {
+        Header *header = objects[i];
+        if (header->marked) {
+            header->marked = 0;
+            objects[kept++] = header;
+        } else {
+            *freedBytes += header->size;
+            heapBytes -= header->size;
+            free(header);
+            freed++;
+        }
+    }
+    objectCount = kept;
+    return freed;
+}
+
+void setCollectionHook(void (*hook)()) {
+    collectionHook = hook;
+}
+
+// Runs a full collection.
+void collectGarbage() {
+    double start = seconds();
+    if (collectionHook != NULL) {
+        collectionHook();
+    }
+    qsort(objects, objectCount, sizeof(Header *), compareHeaders);
+
+    markRange(__data_start, _end);
+    markReachable();
+    markStackRoots();
+
+    size_t freedBytes = 0;
+    size_t freed = sweepChunks(&freedBytes) + sweepObjects(&freedBytes);
+
+    threshold = heapBytes > minimumThreshold ? heapBytes : minimumThreshold;
+    allocatedSinceCollection = 0;
+    collections++;
+    double elapsed = seconds() - start;
+    collectionSeconds += elapsed;
+
+    if (reporting) {
+        double milliseconds = 1000.0 * elapsed;
+        fprintf(stderr, "[gc %d] freed %zu objects (%zu bytes), %zu bytes live in %zu chunks "
+                "and %zu large objects, peak %zu bytes, %.3f ms\n", collections, freed,
+                freedBytes, heapBytes, chunkCount, objectCount, peakHeapBytes, milliseconds);
+    }
+}
+
+// Sets the minimum number of bytes allocated between collections.
+void setCollectionThreshold(size_t bytes) {
+    minimumThreshold = bytes;
+    threshold = bytes;
+}
+
+// Turns per-collection reports on stderr on or off.
+void reportCollections(bool enabled) {
+    reporting = enabled;
+}
+
+size_t bytesAllocated() {
+    return totalAllocated;
+}
+
+AllocationStats allocationStats() {
+    AllocationStats stats = {allocations, bytesRequested, totalAllocated, heapBytes, peakHeapBytes,
+        collections, allocationSeconds, collectionSeconds};
+    return stats;
+}
+
+void timeAllocations(bool enabled) {
+    timing = enabled;
+}
+
+// Allocates a block too large for any size class
+static void *tallocLarge(size_t size) {
+    Header *header = malloc(sizeof(Header) + size);
+    if (header == NULL) {
+        outOfMemory();
+    }
+    header->size = size;
+    header->marked = 0;
+
+    if (objectCount == objectCapacity) {
+        objects = growTable(objects, &objectCapacity, sizeof(Header *));
+    }
+    objects[objectCount++] = header;
+    return header + 1;
+}
+
+// Hands out a block, collecting first if enough has been allocated since
+// the last collection
+static void *allocate(size_t size) {
+    if (allocatedSinceCollection >= threshold) {
+        collectGarbage();
+    }
+
+    if (size > MAX_SMALL_SIZE) {
+        allocatedSinceCollection += size;
+        totalAllocated += size;
+        heapBytes += size;
+        if (heapBytes > peakHeapBytes) {
+            peakHeapBytes = heapBytes;
+        }
+        return tallocLarge(size);
+    }
+
+    int sizeClass = size == 0 ? 0 : (size - 1) / GRANULE;
+    size_t cellSize = (sizeClass + 1) * GRANULE;
+    void *cell = freeLists[sizeClass];
+    Chunk *chunk;
+    size_t index;
+    if (cell != NULL) {
+        freeLists[sizeClass] = *(void **) cell;
+        chunk = (Chunk *) ((uintptr_t) cell & ~(uintptr_t) (CHUNK_SIZE - 1));
+        index = ((char *) cell - chunk->cells) / cellSize;
+    } else {
+        chunk = current[sizeClass];
+        if (chunk == NULL || chunk->used == chunk->cellCount) {
+            chunk = current[sizeClass] = newChunk(sizeClass);
+        }
+        index = chunk->used++;
+        cell = chunk->cells + index * cellSize;
+    }
+    chunk->allocated[index / 32] |= 1u << (index % 32);
+
+    allocatedSinceCollection += cellSize;
+    totalAllocated += cellSize;
+    heapBytes += cellSize;
+    if (heapBytes > peakHeapBytes) {
+        peakHeapBytes = heapBytes;
+    }
+    return cell;
+}
+
+// Replacement for malloc that records the block so the collector can find it
+void *talloc(size_t size) {
+    allocations++;
+    bytesRequested += size;
+    if (tracing) {
+        traceEvent(TRACE_ALLOCATION, NULL, size);
+    }
+    if (!timing) {
+        return allocate(size);
+    }
+    double collecting = collectionSeconds;
+    double start = seconds();
+    void *block = allocate(size);
+    allocationSeconds += seconds() - start - (collectionSeconds - collecting);
+    return block;
+}
+
+// Free all pointers allocated by talloc, releasing chunks wholesale, as well
+// as the tables used to track them.
+void tfree() {
+    if (reporting && collections > 0) {
+        fprintf(stderr, "[gc] %d collections, peak heap %zu bytes\n", collections, peakHeapBytes);
+    }
+    for (size_t i = 0; i < chunkCount; i++) {
+        free(chunks[i]);
+    }
+    for (size_t i = 0; i < objectCount; i++) {
+        free(objects[i]);
+    }
+    free(chunks);
+    free(objects);
+    free(markStack);
+    chunks = NULL;
+    objects = NULL;
+    markStack = NULL;
+    chunkCount = chunkCapacity = 0;
+    objectCount = objectCapacity = 0;
+    markCount = markCapacity = 0;
+    for (int i = 0; i < SIZE_CLASSES; i++) {
+        current[i] = NULL;
+        freeLists[i] = NULL;
+    }
+    heapBytes = 0;
+}
+
+// Replacement for the C function "exit", that frees everything before exiting
+void texit(int status) {
+    tfree();
+    exit(status);
+}
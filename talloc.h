@@ -1,17 +1,58 @@
 #include <stdlib.h>
+#include <stdbool.h>
 #include "value.h"
 
 #ifndef _TALLOC
 #define _TALLOC
 
 
-// Replacement for malloc that stores the pointers allocated. It should store
-// the pointers in some kind of list; a linked list would do fine, but insert
-// here whatever code you'll need to do so; don't call functions in the
-// pre-existing linkedlist.h. Otherwise you'll end up with circular
-// dependencies, since you're going to modify the linked list to use talloc.
+// Replacement for malloc that stores the pointers allocated. Memory returned
+// by talloc is garbage collected: once the collection threshold has been
+// allocated, talloc runs a mark-sweep collection that frees every block no
+// longer reachable from the C stack, the registers or a global variable.
 void *talloc(size_t size);
 
+// Runs a mark-sweep collection immediately.
+void collectGarbage();
+
+// Sets a function for the collector to call before it marks anything. A
+// talloced stack can use it to clear the slots above its top, which the
+// collector would otherwise scan like the rest of the block.
+void setCollectionHook(void (*hook)());
+
+// Sets the number of bytes that may be talloced between two collections. The
+// threshold grows with the live heap, but never drops below this value.
+void setCollectionThreshold(size_t bytes);
+
+// When enabled, prints a line to stderr after every collection with the
+// number of objects and bytes freed and still live, and the peak heap size.
+void reportCollections(bool enabled);
+
+// Returns the total number of bytes talloc has handed out since the program
+// started, counting each block at the size of the cell it was given.
+size_t bytesAllocated();
+
+// What talloc has done since the program started: how many blocks it has
+// handed out, the bytes asked for and the bytes handed out once rounded up to
+// cells, the bytes live now and at most, and the number of collections. Time
+// spent allocating, not counting collections, is only measured once
+// timeAllocations has turned it on; time spent collecting always is.
+typedef struct AllocationStats {
+    size_t allocations;
+    size_t bytesRequested;
+    size_t bytesAllocated;
+    size_t heapBytes;
+    size_t peakHeapBytes;
+    int collections;
+    double allocationSeconds;
+    double collectionSeconds;
+} AllocationStats;
+
+AllocationStats allocationStats();
+
+// Turns timing each talloc on or off
+void timeAllocations(bool enabled);
+
 // Free all pointers allocated by talloc, as well as whatever memory you
 // allocated in lists to hold those pointers.
 void tfree();
@@ -0,0 +1,92 @@
+// tracedump.c
+//
+// Prints a trace written by the interpreter's --trace option (see trace.h)
+// as a timeline, one event per line, with the microseconds since tracing
+// started.
+//
+// usage: tracedump [FILE]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "trace.h"
+
+static char *kindNames[] = {"form", "closure", "primitive", "frame", "alloc"};
+
+static void corrupt(char *path) {
+    fprintf(stderr, "%s: not a complete trace\n", path);
+    exit(1);
+}
+
+int main(int argc, char **argv) {
+    char *path = argc > 1 ? argv[1] : "trace.out";
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        perror(path);
+        return 1;
+    }
+
+    TraceHeader header;
+    if (fread(&header, sizeof(header), 1, file) != 1 ||
+            memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic))) {
+        corrupt(path);
+    }
+    TraceRecord *records = malloc((header.events + 1) * sizeof(TraceRecord));
+    if (fread(records, sizeof(TraceRecord), header.events, file) != header.events) {
+        corrupt(path);
+    }
+
+    // The names are the rest of the file, one after another
+    long start = ftell(file);
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file) - start;
+    fseek(file, start, SEEK_SET);
+    char *text = malloc(size + 1);
+    if (fread(text, 1, size, file) != (size_t) size) {
+        corrupt(path);
+    }
+    text[size] = '\0';
+    char **names = malloc((header.names + 1) * sizeof(char *));
+    char *next = text;
+    for (uint64_t i = 0; i < header.names; i++) {
+        if (next >= text + size) {
+            corrupt(path);
+        }
+        names[i] = next;
+        next += strlen(next) + 1;
+    }
+    fclose(file);
+
+    printf("%llu events recorded, showing the last %llu\n", (unsigned long long) header.recorded,
+            (unsigned long long) header.events);
+    printf("%14s  %-10s %s\n", "time (us)", "event", "detail");
+    for (uint64_t i = 0; i < header.events; i++) {
+        TraceRecord *record = &records[i];
+        if (record->kind > TRACE_ALLOCATION ||
+                (record->name != TRACE_NO_NAME && record->name >= header.names)) {
+            corrupt(path);
+        }
+        char *name = record->name == TRACE_NO_NAME ? NULL : names[record->name];
+        printf("%14.3f  %-10s ", record->time / 1000.0, kindNames[record->kind]);
+        switch (record->kind) {
+            case TRACE_FORM:
+                printf("%s\n", name);
+                break;
+            case TRACE_CLOSURE:
+            case TRACE_PRIMITIVE:
+                printf("%s\n", name == NULL ? "(called by a primitive)" : name);
+                break;
+            case TRACE_FRAME:
+                printf("%u slots\n", record->detail);
+                break;
+            case TRACE_ALLOCATION:
+                printf("%u bytes\n", record->detail);
+                break;
+        }
+    }
+
+    free(records);
+    free(names);
+    free(text);
+    return 0;
+}
@@ -0,0 +1,116 @@
+// trace.c
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include "value.h"
+#include "trace.h"
+
+bool tracing = false;
+
+static char *tracePath;
+// The buffer is malloced, not talloced, so the collector neither scans it nor
+// frees it. The names it holds are interned symbols, which are never freed.
+static TraceEvent *buffer;
+static uint64_t recorded = 0;
+static uint64_t startTime;
+static volatile sig_atomic_t dumpRequested = 0;
+
+static uint64_t nanoseconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+// Dumping from the handler itself could catch eval halfway through changing
+// the buffer, so the handler only asks for the next event to do it
+static void requestDump(int signal) {
+    dumpRequested = 1;
+}
+
+void startTracing(char *path) {
+    tracePath = path;
+    buffer = malloc(TRACE_EVENTS * sizeof(TraceEvent));
+    if (buffer == NULL) {
+        fprintf(stderr, "out of memory for the trace buffer\n");
+        exit(1);
+    }
+    startTime = nanoseconds();
+    signal(SIGUSR1, requestDump);
+    tracing = true;
+}
+
+void traceEvent(traceKind kind, Value *name, uint32_t detail) {
+    TraceEvent *event = &buffer[recorded++ & (TRACE_EVENTS - 1)];
+    event->time = nanoseconds() - startTime;
+    event->name = name;
+    event->detail = detail;
+    event->kind = kind;
+    if (dumpRequested) {
+        dumpRequested = 0;
+        dumpTrace();
+    }
+}
+
+// Gives each distinct name an index, in the order they are first seen,
+// using a table keyed by the symbol's address
+static uint32_t nameIndex(Value *name, Value **table, uint32_t *indexes, size_t capacity,
+        Value **names, uint64_t *count) {
+    if (name == NULL) {
+        return TRACE_NO_NAME;
+    }
+    size_t slot = ((uintptr_t) name >> 3) * 11400714819323198485ull % capacity;
+    while (table[slot] != NULL && table[slot] != name) {
+        slot = (slot + 1) % capacity;
+    }
+    if (table[slot] == NULL) {
+        table[slot] = name;
+        indexes[slot] = *count;
+        names[(*count)++] = name;
+    }
+    return indexes[slot];
+}
+
+void dumpTrace() {
+    FILE *file = fopen(tracePath, "wb");
+    if (file == NULL) {
+        perror(tracePath);
+        return;
+    }
+    uint64_t events = recorded < TRACE_EVENTS ? recorded : TRACE_EVENTS;
+    uint64_t first = recorded - events;
+    size_t capacity = 2 * TRACE_EVENTS;
+    Value **table = calloc(capacity, sizeof(Value *));
+    uint32_t *indexes = malloc(capacity * sizeof(uint32_t));
+    Value **names = malloc((events + 1) * sizeof(Value *));
+    TraceRecord *records = calloc(events + 1, sizeof(TraceRecord));
+    uint64_t nameCount = 0;
+    for (uint64_t i = 0; i < events; i++) {
+        TraceEvent *event = &buffer[(first + i) & (TRACE_EVENTS - 1)];
+        records[i].time = event->time;
+        records[i].name = nameIndex(event->name, table, indexes, capacity, names, &nameCount);
+        records[i].detail = event->detail;
+        records[i].kind = event->kind;
+    }
+
+    TraceHeader header;
+    memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    header.recorded = recorded;
+    header.events = events;
+    header.names = nameCount;
+    fwrite(&header, sizeof(header), 1, file);
+    fwrite(records, sizeof(TraceRecord), events, file);
+    for (uint64_t i = 0; i < nameCount; i++) {
+        fwrite(names[i]->s, 1, strlen(names[i]->s) + 1, file);
+    }
+    fclose(file);
+    fprintf(stderr, "[trace] wrote %llu of %llu events to %s\n", (unsigned long long) events,
+            (unsigned long long) recorded, tracePath);
+
+    free(table);
+    free(indexes);
+    free(names);
+    free(records);
+}
@@ -0,0 +1,68 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include "value.h"
+
+#ifndef _TRACE
+#define _TRACE
+
+// The tracer. When it is on, eval records an event each time it enters a
+// special form or calls a closure or primitive, and every frame and talloc
+// is recorded too, with the nanoseconds since tracing started. Events go into
+// a fixed-size ring buffer, so only the latest TRACE_EVENTS are kept. The
+// buffer is written to a file when an evaluation error happens, or at the
+// next event after the process gets SIGUSR1, and tools/tracedump.c prints it
+// as a timeline.
+//
+// Everything that records an event checks tracing first, so the tracer costs
+// a branch per event when it is off.
+
+#define TRACE_EVENTS (1 << 16)
+
+typedef enum {TRACE_FORM, TRACE_CLOSURE, TRACE_PRIMITIVE, TRACE_FRAME, TRACE_ALLOCATION} traceKind;
+
+// An event as it is kept in the buffer. name is the interned symbol naming
+// the special form or procedure, or NULL if the procedure was reached some
+// other way; detail is the form's number, the frame's slots or the bytes
+// allocated.
+typedef struct TraceEvent {
+    uint64_t time;
+    Value *name;
+    uint32_t detail;
+    uint32_t kind;
+} TraceEvent;
+
+// The file the buffer is written to starts with this header. The events
+// follow, oldest first, as TraceRecords, and then the names, each ending in
+// a NUL, in the order of their indexes. Events with no name have index
+// TRACE_NO_NAME.
+#define TRACE_MAGIC "EVTRACE1"
+#define TRACE_NO_NAME UINT32_MAX
+
+typedef struct TraceHeader {
+    char magic[8];
+    // Every event recorded, including those the ring buffer dropped
+    uint64_t recorded;
+    uint64_t events;
+    uint64_t names;
+} TraceHeader;
+
+typedef struct TraceRecord {
+    uint64_t time;
+    uint32_t name;
+    uint32_t detail;
+    uint32_t kind;
+    uint32_t unused;
+} TraceRecord;
+
+extern bool tracing;
+
+// Turns the tracer on, writing the buffer to the given file when it is dumped
+void startTracing(char *path);
+
+// Records an event
+void traceEvent(traceKind kind, Value *name, uint32_t detail);
+
+// Writes the buffer out now
+void dumpTrace();
+
+#endif
@@ -0,0 +1,87 @@
+// value.c
+
+// Constructors for the values the interpreter makes most often. Values are
+// never changed once they are made, so one #t, one #f, one void, one empty
+// list and one of each small number can be shared by everything that needs
+// them. Those are held here, outside the heap, and making them never
+// allocates.
+
+#include <math.h>
+#include "value.h"
+#include "talloc.h"
+
+#define SMALL_MIN -128
+#define SMALL_MAX 1023
+#define SMALL_COUNT (SMALL_MAX - SMALL_MIN + 1)
+
+static Value trueValue = {BOOL_TYPE, {.i = 1}};
+static Value falseValue = {BOOL_TYPE, {.i = 0}};
+static Value voidValue = {VOID_TYPE};
+static Value emptyList = {NULL_TYPE};
+
+// How many values of each type have been allocated
+static size_t made[VALUE_TYPES];
+
+// The small integers, and the doubles with the same values, filled in on
+// first use
+static Value smallInts[SMALL_COUNT];
+static Value smallDoubles[SMALL_COUNT];
+static bool smallFilled = false;
+
+static void fillSmall() {
+    for (int i = 0; i < SMALL_COUNT; i++) {
+        smallInts[i].type = INT_TYPE;
+        smallInts[i].i = i + SMALL_MIN;
+        smallDoubles[i].type = DOUBLE_TYPE;
+        smallDoubles[i].d = i + SMALL_MIN;
+    }
+    smallFilled = true;
+}
+
+Value *newValue(valueType type) {
+    Value *value = talloc(sizeof(Value));
+    value->type = type;
+    made[type]++;
+    return value;
+}
+
+size_t valuesMade(valueType type) {
+    return made[type];
+}
+
+Value *makeBool(bool value) {
+    return value ? &trueValue : &falseValue;
+}
+
+Value *makeVoid() {
+    return &voidValue;
+}
+
+Value *makeEmptyList() {
+    return &emptyList;
+}
+
+Value *makeInt(int64_t i) {
+    if (i >= SMALL_MIN && i <= SMALL_MAX) {
+        if (!smallFilled) {
+            fillSmall();
+        }
+        return &smallInts[i - SMALL_MIN];
+    }
+    Value *value = newValue(INT_TYPE);
+    value->i = i;
+    return value;
+}
+
+Value *makeDouble(double d) {
+    // -0.0 prints differently from 0.0, so it isn't shared
+    if (d >= SMALL_MIN && d <= SMALL_MAX && d == (int) d && !signbit(d)) {
+        if (!smallFilled) {
+            fillSmall();
+        }
+        return &smallDoubles[(int) d - SMALL_MIN];
+    }
+    Value *value = newValue(DOUBLE_TYPE);
+    value->d = d;
+    return value;
+}
@@ -1,24 +1,70 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
 #ifndef _VALUE
 #define _VALUE
 
-typedef enum {INT_TYPE,DOUBLE_TYPE,STR_TYPE,CONS_TYPE,NULL_TYPE,PTR_TYPE, OPEN_TYPE,CLOSE_TYPE,BOOL_TYPE,SYMBOL_TYPE,CLOSURE_TYPE,VOID_TYPE,PRIMITIVE_TYPE} valueType;
+typedef enum {INT_TYPE,DOUBLE_TYPE,STR_TYPE,CONS_TYPE,NULL_TYPE,PTR_TYPE, OPEN_TYPE,CLOSE_TYPE,BOOL_TYPE,SYMBOL_TYPE,CLOSURE_TYPE,VOID_TYPE,PRIMITIVE_TYPE,LOCAL_TYPE,SCOPE_TYPE,VECTOR_TYPE,HASH_TYPE,VALUE_TYPES} valueType;
 
 struct Value {
     valueType type;
     union {
-        int i;
+        int64_t i;
         double d;
         char *s;
         void *p;
+        // An interned symbol: its name, which is also s, the special form
+        // it names, if any (see symbol.h), whether it names a primitive the
+        // folding pass folds calls to (see fold.c), and the global binding
+        // it was last found to name, which is good while version is still
+        // globalsVersion (see globals.h)
+        struct Symbol {
+            char *name;
+            uint16_t form;
+            bool foldable;
+            uint32_t version;
+            struct Value *pair;
+        } sym;
         struct ConsCell {
             struct Value *car;
             struct Value *cdr;
         } c;
         struct Closure {
-            struct Value *paramNames;
+            // The SCOPE_TYPE describing the frame each call creates
+            struct Value *scope;
             struct Value *functionCode;
             struct Frame *frame;
         } cl;
+        // A variable reference resolved to a slot in a frame, depth frames up
+        // from the one the reference is evaluated in
+        struct Local {
+            int depth;
+            int slot;
+            struct Value *symbol;
+        } local;
+        // The layout of a frame created by a lambda or let: the names of its
+        // slots in order, how many of them are parameters or bindings, and
+        // how many slots there are in total, counting internal defines. A
+        // lambda's body is compiled into code by vm.c, or into a node by
+        // analyze.c, the first time it is called by whichever engine is
+        // running.
+        struct Scope {
+            struct Value *names;
+            int params;
+            int size;
+            union {
+                struct Code *code;
+                struct Node *node;
+            };
+        } scope;
+        // A vector's elements, which are stored contiguously (see vector.h)
+        struct Vector {
+            struct Value **items;
+            int64_t size;
+        } vec;
+        // A hash table (see hash.h)
+        struct HashTable *hash;
         // A pointer to a primitive style function named pf
         struct Value *(*pf)(struct Value *);
     };
@@ -27,4 +73,21 @@ struct Value {
 
 typedef struct Value Value;
 
+// Allocates a value of the given type, counting it in the statistics kept by
+// type. Every allocated Value is made here.
+Value *newValue(valueType type);
+
+// Returns how many values of the given type have been allocated. Shared
+// values aren't counted, since they are never allocated.
+size_t valuesMade(valueType type);
+
+// Make values of the common types. #t, #f, void, the empty list and small
+// numbers are shared rather than allocated, so the values these return must
+// never be changed (see value.c).
+Value *makeBool(bool value);
+Value *makeVoid();
+Value *makeEmptyList();
+Value *makeInt(int64_t i);
+Value *makeDouble(double d);
+
 #endif
@@ -0,0 +1,114 @@
+// vector.c
+
+// Vectors: a VECTOR_TYPE value pointing to a talloced array of elements.
+
+#include <stdint.h>
+#include "value.h"
+#include "linkedlist.h"
+#include "talloc.h"
+#include "interpreter.h"
+#include "vector.h"
+
+// The longest vector make-vector will make. Nothing longer could be
+// allocated, and the size of its elements in bytes could overflow a size_t.
+#define MAX_VECTOR_SIZE ((int64_t) (SIZE_MAX / 2 / sizeof(Value *)))
+
+// Makes a vector with room for the given number of elements, all unset
+static Value *makeVector(int64_t size) {
+    Value *vector = newValue(VECTOR_TYPE);
+    vector->vec.size = size;
+    vector->vec.items = size > 0 ? talloc(size * sizeof(Value *)) : NULL;
+    return vector;
+}
+
+// Returns the vector that is the first argument, checking there are the
+// given number of arguments
+static Value *vectorArgument(Value *args, int count) {
+    if (length(args) != count || car(args)->type != VECTOR_TYPE) {
+        evaluationError();
+    }
+    return car(args);
+}
+
+// Returns the index that is the second argument, checking it is in range
+static int64_t indexArgument(Value *vector, Value *args) {
+    Value *index = car(cdr(args));
+    if (index->type != INT_TYPE || index->i < 0 || index->i >= vector->vec.size) {
+        evaluationError();
+    }
+    return index->i;
+}
+
+Value *primitiveMakeVector(Value *args) {
+    int count = length(args);
+    if (count < 1 || count > 2 || car(args)->type != INT_TYPE || car(args)->i < 0 ||
+            car(args)->i > MAX_VECTOR_SIZE) {
+        evaluationError();
+    }
+    Value *fill = count == 2 ? car(cdr(args)) : makeInt(0);
+    Value *vector = makeVector(car(args)->i);
+    for (int64_t i = 0; i < vector->vec.size; i++) {
+        vector->vec.items[i] = fill;
+    }
+    return vector;
+}
+
+Value *primitiveVector(Value *args) {
+    Value *vector = makeVector(length(args));
+    for (int64_t i = 0; i < vector->vec.size; i++) {
+        vector->vec.items[i] = car(args);
+        args = cdr(args);
+    }
+    return vector;
+}
+
+Value *primitiveIsVector(Value *args) {
+    if (length(args) != 1) {
+        evaluationError();
+    }
+    return makeBool(car(args)->type == VECTOR_TYPE);
+}
+
+Value *primitiveVectorLength(Value *args) {
+    return makeInt(vectorArgument(args, 1)->vec.size);
+}
+
+Value *primitiveVectorRef(Value *args) {
+    Value *vector = vectorArgument(args, 2);
+    return vector->vec.items[indexArgument(vector, args)];
+}
+
+Value *primitiveVectorSet(Value *args) {
+    Value *vector = vectorArgument(args, 3);
+    vector->vec.items[indexArgument(vector, args)] = car(cdr(cdr(args)));
+    return makeVoid();
+}
+
+Value *primitiveVectorToList(Value *args) {
+    Value *vector = vectorArgument(args, 1);
+    Value *list = makeNull();
+    for (int64_t i = vector->vec.size - 1; i >= 0; i--) {
+        list = cons(vector->vec.items[i], list);
+    }
+    return list;
+}
+
+Value *primitiveListToVector(Value *args) {
+    if (length(args) != 1) {
+        evaluationError();
+    }
+    Value *list = car(args);
+    int64_t size = 0;
+    for (Value *rest = list; rest->type != NULL_TYPE; rest = rest->c.cdr) {
+        if (rest->type != CONS_TYPE) {
+            evaluationError();
+        }
+        size++;
+    }
+    Value *vector = makeVector(size);
+    for (int64_t i = 0; i < size; i++) {
+        vector->vec.items[i] = list->c.car;
+        list = list->c.cdr;
+    }
+    return vector;
+}
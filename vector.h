@@ -0,0 +1,36 @@
+#include "value.h"
+
+#ifndef _VECTOR
+#define _VECTOR
+
+// The vector primitives. A VECTOR_TYPE holds its elements contiguously, so
+// they are read and written in constant time. Each takes its arguments as a
+// list, like every primitive, and reports bad arguments with an evaluation
+// error.
+
+// (make-vector k) or (make-vector k fill): a vector of k elements, each fill,
+// or 0 if there is no fill
+Value *primitiveMakeVector(Value *args);
+
+// (vector v ...): a vector of the arguments
+Value *primitiveVector(Value *args);
+
+// (vector? v)
+Value *primitiveIsVector(Value *args);
+
+// (vector-length vec)
+Value *primitiveVectorLength(Value *args);
+
+// (vector-ref vec k): element k, counting from 0
+Value *primitiveVectorRef(Value *args);
+
+// (vector-set! vec k v): replaces element k
+Value *primitiveVectorSet(Value *args);
+
+// (vector->list vec)
+Value *primitiveVectorToList(Value *args);
+
+// (list->vector list)
+Value *primitiveListToVector(Value *args);
+
+#endif
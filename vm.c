@@ -0,0 +1,683 @@
+// vm.c
+
+// The bytecode compiler and virtual machine. An expression is compiled once
+// into a flat array of instructions, so running it no longer means picking
+// apart cons cells. The machine keeps intermediate values on a stack, and
+// lambda calls don't recurse in C: a call saves where to return to on a
+// separate stack of returns, and a tail call doesn't even do that.
+//
+// Frames are the same as the tree walker's, so variables are still found by
+// the depth and slot the resolver gave them, and closures made by either
+// engine can be called by the other.
+
+#include <string.h>
+#include "value.h"
+#include "linkedlist.h"
+#include "talloc.h"
+#include "interpreter.h"
+#include "symbol.h"
+#include "globals.h"
+#include "vm.h"
+#include "profile.h"
+
+// The instructions. Operands follow the opcode in the instruction array.
+typedef enum {
+    CONST_OP,        // index: push a constant
+    GLOBAL_OP,       // index: push the value of a global, named by a constant
+    LOCAL_OP,        // depth slot: push the value in a frame slot
+    SET_GLOBAL_OP,   // index: pop a value, set! a global to it, push void
+    SET_LOCAL_OP,    // depth slot: pop a value, set! a slot to it, push void
+    DEFINE_GLOBAL_OP,// index: pop a value, define a global as it, push void
+    DEFINE_LOCAL_OP, // depth slot: pop a value, define a slot as it, push void
+    STORE_OP,        // slot: pop a value into a slot of the current frame
+    VOID_OP,         // push void
+    POP_OP,          // discard the top of the stack
+    JUMP_OP,         // target: continue at the target
+    IF_OP,           // target: pop an 'if' test, jump unless it's true
+    COND_OP,         // target: pop a 'cond' test of a variable, jump unless true
+    COND_ONE_OP,     // target: pop any other 'cond' test, jump unless its i is 1
+    FOLDED_OP,       // version target: jump if the primitives have been
+                     // rebound since that version
+    AND_OP,          // count: pop that many booleans, push their 'and'
+    OR_OP,           // count: pop that many booleans, push their 'or'
+    CLOSURE_OP,      // index: push a closure for (lambda <scope> params body)
+    LET_OP,          // index count: enter a frame with the scope constant,
+                     // popping the values of its first count slots
+    ENTER_OP,        // index: enter an empty frame with the scope constant
+    LEAVE_OP,        // go back to the frame the current one was entered from
+    CALL_OP,         // count: call the function below count arguments
+    TAIL_CALL_OP,    // count: the same, in place of the current call
+    RETURN_OP,       // return the top of the stack to the caller
+    ERROR_OP         // raise an evaluation error
+} opcode;
+
+// Code being compiled, with room to grow
+typedef struct Compiler {
+    int *ops;
+    int length;
+    int capacity;
+    Value **constants;
+    int count;
+    int constantCapacity;
+} Compiler;
+
+// Where a call returns to
+typedef struct Return {
+    Code *code;
+    int pc;
+    Frame *frame;
+} Return;
+
+// The value stack and the return stack. Both are talloc'd, and reached from
+// here, so the collector sees everything on them. Before each collection the
+// slots above their tops are cleared (see clearPopped), so what has been
+// popped isn't kept alive.
+static Value **stack;
+static int stackCapacity;
+static int sp;
+static Return *returns;
+static int returnCapacity;
+static int returnCount;
+
+static void compileExpr(Value *expr, bool tail, Compiler *compiler);
+
+// Appends a word to the code being compiled, and returns its position
+static int emit(int word, Compiler *compiler) {
+    if (compiler->length == compiler->capacity) {
+        compiler->capacity *= 2;
+        int *ops = talloc(compiler->capacity * sizeof(int));
+        memcpy(ops, compiler->ops, compiler->length * sizeof(int));
+        compiler->ops = ops;
+    }
+    compiler->ops[compiler->length] = word;
+    return compiler->length++;
+}
+
+// Adds a constant to the code being compiled, and returns its index
+static int addConstant(Value *value, Compiler *compiler) {
+    for (int i = 0; i < compiler->count; i++) {
+        if (compiler->constants[i] == value) {
+            return i;
+        }
+    }
+    if (compiler->count == compiler->constantCapacity) {
+        compiler->constantCapacity *= 2;
+        Value **constants = talloc(compiler->constantCapacity * sizeof(Value *));
+        memcpy(constants, compiler->constants, compiler->count * sizeof(Value *));
+        compiler->constants = constants;
+    }
+    compiler->constants[compiler->count] = value;
+    return compiler->count++;
+}
+
+// Emits an instruction with one operand
+static void emitOp(opcode op, int operand, Compiler *compiler) {
+    emit(op, compiler);
+    emit(operand, compiler);
+}
+
+// Emits a jump with its target still to be filled in by patch, and returns
+// where the target goes
+static int emitJump(opcode op, Compiler *compiler) {
+    emit(op, compiler);
+    return emit(-1, compiler);
+}
+
+// Points a jump at the next instruction to be emitted
+static void patch(int jump, Compiler *compiler) {
+    compiler->ops[jump] = compiler->length;
+}
+
+// Emits an instruction taking a variable's depth and slot
+static void emitLocal(opcode op, Value *local, Compiler *compiler) {
+    emit(op, compiler);
+    emit(local->local.depth, compiler);
+    emit(local->local.slot, compiler);
+}
+
+// An expression in tail position returns its value once it has one
+static void finish(bool tail, Compiler *compiler) {
+    if (tail) {
+        emit(RETURN_OP, compiler);
+    }
+}
+
+// Compiles the expressions of a begin or a cond clause. Only the value of the
+// last one is kept, and it is in tail position if the body is.
+static void compileBody(Value *body, bool tail, Compiler *compiler) {
+    if (body->type != CONS_TYPE) {
+        emit(VOID_OP, compiler);
+        finish(tail, compiler);
+        return;
+    }
+    while (cdr(body)->type == CONS_TYPE) {
+        compileExpr(car(body), false, compiler);
+        emit(POP_OP, compiler);
+        body = cdr(body);
+    }
+    compileExpr(car(body), tail, compiler);
+}
+
+// Compiles (if test then else). A test that doesn't evaluate to a boolean is
+// evaluated again, as evalIf does.
+static void compileIf(Value *args, bool tail, Compiler *compiler) {
+    if (length(args) != 3) {
+        emit(ERROR_OP, compiler);
+        return;
+    }
+    compileExpr(car(args), false, compiler);
+    int otherwise = emitJump(IF_OP, compiler);
+    compileExpr(car(cdr(args)), tail, compiler);
+    int end = tail ? -1 : emitJump(JUMP_OP, compiler);
+    patch(otherwise, compiler);
+    compileExpr(car(cdr(cdr(args))), tail, compiler);
+    if (!tail) {
+        patch(end, compiler);
+    }
+}
+
+// Compiles (folded <version> replacement original). The replacement comes
+// first, and the original is jumped to if the primitives have been rebound.
+static void compileFolded(Value *args, bool tail, Compiler *compiler) {
+    emit(FOLDED_OP, compiler);
+    emit((int) car(args)->i, compiler);
+    int stale = emit(-1, compiler);
+    compileExpr(car(cdr(args)), tail, compiler);
+    int end = tail ? -1 : emitJump(JUMP_OP, compiler);
+    patch(stale, compiler);
+    compileExpr(car(cdr(cdr(args))), tail, compiler);
+    if (!tail) {
+        patch(end, compiler);
+    }
+}
+
+// Compiles (cond (test body...)... (else body...)), testing each clause the
+// way evalCond does
+static void compileCond(Value *args, bool tail, Compiler *compiler) {
+    // The jumps from the end of each clause body to the end of the cond
+    int *ends = talloc((length(args) + 1) * sizeof(int));
+    int count = 0;
+    // Whether the clauses compiled so far leave nothing for a later one
+    bool done = false;
+    for (Value *clauses = args; clauses->type == CONS_TYPE && !done; clauses = cdr(clauses)) {
+        Value *clause = car(clauses);
+        Value *first = clause->type == CONS_TYPE ? car(clause) : clause;
+        int next = -1;
+        if (clause->type != CONS_TYPE || (first == elseSymbol && cdr(clauses)->type != NULL_TYPE)) {
+            emit(ERROR_OP, compiler);
+            done = true;
+            break;
+        } else if (first == elseSymbol) {
+            done = true;
+        } else if (first->type == SYMBOL_TYPE || first->type == LOCAL_TYPE) {
+            compileExpr(first, false, compiler);
+            next = emitJump(COND_OP, compiler);
+        } else if (first->type == BOOL_TYPE || first->type == CONS_TYPE) {
+            compileExpr(first, false, compiler);
+            next = emitJump(COND_ONE_OP, compiler);
+        } else {
+            emit(ERROR_OP, compiler);
+            done = true;
+            break;
+        }
+        compileBody(cdr(clause), tail, compiler);
+        if (!tail) {
+            ends[count++] = emitJump(JUMP_OP, compiler);
+        }
+        if (next != -1) {
+            patch(next, compiler);
+        }
+    }
+    if (!done) {
+        emit(VOID_OP, compiler);
+        finish(tail, compiler);
+    }
+    for (int i = 0; i < count; i++) {
+        patch(ends[i], compiler);
+    }
+}
+
+// Compiles (let <scope> ((name expr)...) body). The bindings are evaluated
+// before the new frame is entered.
+static void compileLet(Value *args, bool tail, Compiler *compiler) {
+    if (car(args)->type != SCOPE_TYPE) {
+        emit(ERROR_OP, compiler);
+        return;
+    }
+    int count = 0;
+    for (Value *bindings = car(cdr(args)); bindings->type != NULL_TYPE; bindings = cdr(bindings)) {
+        compileExpr(car(cdr(car(bindings))), false, compiler);
+        count++;
+    }
+    emitOp(LET_OP, addConstant(car(args), compiler), compiler);
+    emit(count, compiler);
+    compileExpr(car(cdr(cdr(args))), tail, compiler);
+    if (!tail) {
+        emit(LEAVE_OP, compiler);
+    }
+}
+
+// Compiles let* and letrec, whose bindings are evaluated in the new frame
+static void compileLetStar(Value *args, bool tail, Compiler *compiler) {
+    if (car(args)->type != SCOPE_TYPE) {
+        emit(ERROR_OP, compiler);
+        return;
+    }
+    emitOp(ENTER_OP, addConstant(car(args), compiler), compiler);
+    int slot = 0;
+    for (Value *bindings = car(cdr(args)); bindings->type != NULL_TYPE; bindings = cdr(bindings)) {
+        compileExpr(car(cdr(car(bindings))), false, compiler);
+        emitOp(STORE_OP, slot, compiler);
+        slot++;
+    }
+    compileExpr(car(cdr(cdr(args))), tail, compiler);
+    if (!tail) {
+        emit(LEAVE_OP, compiler);
+    }
+}
+
+// Compiles set! or define, which are checked the same way
+static void compileAssignment(Value *args, opcode global, opcode local, Compiler *compiler) {
+    Value *name = car(args);
+    if (length(args) != 2 || (name->type != SYMBOL_TYPE && name->type != LOCAL_TYPE)) {
+        emit(ERROR_OP, compiler);
+        return;
+    }
+    compileExpr(car(cdr(args)), false, compiler);
+    if (name->type == LOCAL_TYPE) {
+        emitLocal(local, name, compiler);
+    } else {
+        emitOp(global, addConstant(name, compiler), compiler);
+    }
+}
+
+// Compiles a special form, given the form its head symbol is tagged with
+static void compileForm(specialForm form, Value *args, bool tail, Compiler *compiler) {
+    switch (form) {
+        case IF_FORM:
+            compileIf(args, tail, compiler);
+            return;
+        case COND_FORM:
+            compileCond(args, tail, compiler);
+            return;
+        case LET_FORM:
+            compileLet(args, tail, compiler);
+            return;
+        case LET_STAR_FORM:
+        case LETREC_FORM:
+            compileLetStar(args, tail, compiler);
+            return;
+        case BEGIN_FORM:
+            compileBody(args, tail, compiler);
+            return;
+        case FOLDED_FORM:
+            compileFolded(args, tail, compiler);
+            return;
+        case SET_BANG_FORM:
+            compileAssignment(args, SET_GLOBAL_OP, SET_LOCAL_OP, compiler);
+            break;
+        case DEFINE_FORM:
+            compileAssignment(args, DEFINE_GLOBAL_OP, DEFINE_LOCAL_OP, compiler);
+            break;
+        case QUOTE_FORM:
+            if (length(args) != 1) {
+                emit(ERROR_OP, compiler);
+                return;
+            }
+            emitOp(CONST_OP, addConstant(car(args), compiler), compiler);
+            break;
+        case LAMBDA_FORM:
+            if (car(args)->type != SCOPE_TYPE) {
+                emit(ERROR_OP, compiler);
+                return;
+            }
+            emitOp(CLOSURE_OP, addConstant(args, compiler), compiler);
+            break;
+        case AND_FORM:
+        case OR_FORM:
+            if (length(args) < 2) {
+                emit(ERROR_OP, compiler);
+                return;
+            }
+            for (Value *current = args; current->type != NULL_TYPE; current = cdr(current)) {
+                compileExpr(car(current), false, compiler);
+            }
+            emitOp(form == AND_FORM ? AND_OP : OR_OP, length(args), compiler);
+            break;
+        default:
+            emit(ERROR_OP, compiler);
+            return;
+    }
+    finish(tail, compiler);
+}
+
+// Compiles one expression, leaving its value on the stack, or returning it
+// if the expression is in tail position
+static void compileExpr(Value *expr, bool tail, Compiler *compiler) {
+    switch (expr->type) {
+        case INT_TYPE:
+        case DOUBLE_TYPE:
+        case STR_TYPE:
+        case BOOL_TYPE:
+        case NULL_TYPE:
+        case CLOSURE_TYPE:
+        case PRIMITIVE_TYPE:
+        case VECTOR_TYPE:
+        case HASH_TYPE:
+            emitOp(CONST_OP, addConstant(expr, compiler), compiler);
+            break;
+        case SYMBOL_TYPE:
+            emitOp(GLOBAL_OP, addConstant(expr, compiler), compiler);
+            break;
+        case LOCAL_TYPE:
+            emitLocal(LOCAL_OP, expr, compiler);
+            break;
+        case CONS_TYPE: {
+            Value *head = car(expr);
+            if (head->type == SYMBOL_TYPE && head->sym.form != NO_FORM) {
+                compileForm(head->sym.form, cdr(expr), tail, compiler);
+                return;
+            }
+            if (head->type != SYMBOL_TYPE && head->type != LOCAL_TYPE) {
+                // Like eval, treat anything else as data
+                emitOp(CONST_OP, addConstant(expr, compiler), compiler);
+                break;
+            }
+            int count = 0;
+            for (Value *current = expr; current->type != NULL_TYPE; current = cdr(current)) {
+                compileExpr(car(current), false, compiler);
+                count++;
+            }
+            // A tail call to a primitive comes back, and then returns
+            emitOp(tail ? TAIL_CALL_OP : CALL_OP, count - 1, compiler);
+            break;
+        }
+        default:
+            emit(ERROR_OP, compiler);
+            return;
+    }
+    finish(tail, compiler);
+}
+
+Code *compile(Value *expr) {
+    Compiler compiler;
+    compiler.length = 0;
+    compiler.capacity = 16;
+    compiler.ops = talloc(compiler.capacity * sizeof(int));
+    compiler.count = 0;
+    compiler.constantCapacity = 4;
+    compiler.constants = talloc(compiler.constantCapacity * sizeof(Value *));
+    compileExpr(expr, true, &compiler);
+
+    Code *code = talloc(sizeof(Code));
+    code->ops = compiler.ops;
+    code->length = compiler.length;
+    code->constants = compiler.constants;
+    return code;
+}
+
+// Pushes a value onto the value stack, making room if need be
+static void push(Value *value) {
+    if (sp == stackCapacity) {
+        stackCapacity = stackCapacity == 0 ? 1024 : stackCapacity * 2;
+        Value **bigger = talloc(stackCapacity * sizeof(Value *));
+        memcpy(bigger, stack, sp * sizeof(Value *));
+        stack = bigger;
+    }
+    stack[sp++] = value;
+}
+
+// Clears the slots of both stacks that are above their tops. This is left to
+// the collector to call rather than done at every pop or return.
+static void clearPopped() {
+    if (stackCapacity > sp) {
+        memset(&stack[sp], 0, (stackCapacity - sp) * sizeof(Value *));
+    }
+    if (returnCapacity > returnCount) {
+        memset(&returns[returnCount], 0, (returnCapacity - returnCount) * sizeof(Return));
+    }
+}
+
+// Saves where the current call should return to
+static void pushReturn(Code *code, int pc, Frame *frame) {
+    if (returnCount == returnCapacity) {
+        returnCapacity = returnCapacity == 0 ? 256 : returnCapacity * 2;
+        Return *bigger = talloc(returnCapacity * sizeof(Return));
+        memcpy(bigger, returns, returnCount * sizeof(Return));
+        returns = bigger;
+    }
+    returns[returnCount].code = code;
+    returns[returnCount].pc = pc;
+    returns[returnCount].frame = frame;
+    returnCount++;
+}
+
+// Returns the compiled body of a closure, compiling it on its first call
+static Code *bodyOf(Value *closure) {
+    Value *scope = closure->cl.scope;
+    if (scope->scope.code == NULL) {
+        scope->scope.code = compile(closure->cl.functionCode);
+    }
+    return scope->scope.code;
+}
+
+// Creates the frame for a call to a closure, taking its arguments off the top
+// of the stack
+static Frame *bindStacked(Value *closure, int count) {
+    Value *scope = closure->cl.scope;
+    if (count != scope->scope.params) {
+        evaluationError();
+    }
+    Frame *frame = newFrame(scope, closure->cl.frame);
+    memcpy(frame->slots, &stack[sp - count], count * sizeof(Value *));
+    return frame;
+}
+
+// Calls a primitive function on the arguments at the top of the stack
+static Value *callPrimitive(Value *function, int count) {
+    Value *args = makeEmptyList();
+    for (int i = sp - 1; i >= sp - count; i--) {
+        args = cons(stack[i], args);
+    }
+    if (profiling) {
+        return profilePrimitive(function, args);
+    }
+    return function->pf(args);
+}
+
+// Runs code in a frame until it returns, and returns its value
+static Value *run(Code *code, Frame *frame) {
+    int base = returnCount;
+    int profileBase = profiling ? profileDepth() : 0;
+    int *ops = code->ops;
+    int pc = 0;
+    while (true) {
+        int op = ops[pc++];
+        switch (op) {
+            case CONST_OP:
+                push(code->constants[ops[pc++]]);
+                break;
+            case GLOBAL_OP:
+                push(lookUpSymbol(code->constants[ops[pc++]], frame));
+                break;
+            case LOCAL_OP: {
+                Frame *owner = frame;
+                for (int depth = ops[pc]; depth > 0; depth--) {
+                    owner = owner->parent;
+                }
+                Value *value = owner->slots[ops[pc + 1]];
+                if (value == NULL) {
+                    // Used before its define or letrec binding was evaluated
+                    evaluationError();
+                }
+                push(value);
+                pc += 2;
+                break;
+            }
+            case SET_GLOBAL_OP: {
+                setGlobal(findPair(code->constants[ops[pc++]], frame), stack[sp - 1]);
+                stack[sp - 1] = makeVoid();
+                break;
+            }
+            case SET_LOCAL_OP:
+            case DEFINE_LOCAL_OP: {
+                Frame *owner = frame;
+                for (int depth = ops[pc]; depth > 0; depth--) {
+                    owner = owner->parent;
+                }
+                Value **slot = &owner->slots[ops[pc + 1]];
+                if (op == SET_LOCAL_OP && *slot == NULL) {
+                    evaluationError();
+                }
+                *slot = stack[sp - 1];
+                stack[sp - 1] = makeVoid();
+                pc += 2;
+                break;
+            }
+            case DEFINE_GLOBAL_OP: {
+                defineGlobal(topFrame(frame)->globals, code->constants[ops[pc++]], stack[sp - 1]);
+                stack[sp - 1] = makeVoid();
+                break;
+            }
+            case STORE_OP:
+                frame->slots[ops[pc++]] = stack[--sp];
+                break;
+            case VOID_OP:
+                push(makeVoid());
+                break;
+            case POP_OP:
+                sp--;
+                break;
+            case JUMP_OP:
+                pc = ops[pc];
+                break;
+            case FOLDED_OP:
+                pc = (uint32_t) ops[pc] == primitivesVersion ? pc + 2 : ops[pc + 1];
+                break;
+            case IF_OP: {
+                Value *test = stack[--sp];
+                if (test->type != BOOL_TYPE) {
+                    test = eval(test, frame);
+                    if (test->type != BOOL_TYPE) {
+                        evaluationError();
+                    }
+                }
+                pc = test->i == 1 ? pc + 1 : ops[pc];
+                break;
+            }
+            case COND_OP: {
+                Value *test = stack[--sp];
+                if (test->type != BOOL_TYPE) {
+                    evaluationError();
+                }
+                pc = test->i == 1 ? pc + 1 : ops[pc];
+                break;
+            }
+            case COND_ONE_OP:
+                pc = stack[--sp]->i == 1 ? pc + 1 : ops[pc];
+                break;
+            case AND_OP:
+            case OR_OP: {
+                // Every argument must be a boolean, as in evalAnd and evalOr
+                int count = ops[pc++];
+                bool result = op == AND_OP;
+                for (int i = sp - count; i < sp; i++) {
+                    if (stack[i]->type != BOOL_TYPE) {
+                        evaluationError();
+                    }
+                    if (stack[i]->i == (op == OR_OP)) {
+                        result = op == OR_OP;
+                    }
+                }
+                sp -= count;
+                push(makeBool(result));
+                break;
+            }
+            case CLOSURE_OP: {
+                Value *lambda = code->constants[ops[pc++]];
+                Value *closure = newValue(CLOSURE_TYPE);
+                closure->cl.frame = frame;
+                closure->cl.scope = car(lambda);
+                closure->cl.functionCode = car(cdr(cdr(lambda)));
+                push(closure);
+                break;
+            }
+            case LET_OP: {
+                int count = ops[pc + 1];
+                frame = newFrame(code->constants[ops[pc]], frame);
+                memcpy(frame->slots, &stack[sp - count], count * sizeof(Value *));
+                sp -= count;
+                pc += 2;
+                break;
+            }
+            case ENTER_OP:
+                frame = newFrame(code->constants[ops[pc++]], frame);
+                break;
+            case LEAVE_OP:
+                frame = frame->parent;
+                break;
+            case CALL_OP:
+            case TAIL_CALL_OP: {
+                int count = ops[pc++];
+                Value *function = stack[sp - count - 1];
+                if (function->type == CLOSURE_TYPE) {
+                    Frame *callee = bindStacked(function, count);
+                    sp -= count + 1;
+                    if (profiling) {
+                        if (op == CALL_OP) {
+                            profileEnter(function);
+                        } else {
+                            profileCall(function, profileBase);
+                        }
+                    }
+                    if (op == CALL_OP) {
+                        pushReturn(code, pc, frame);
+                    }
+                    code = bodyOf(function);
+                    ops = code->ops;
+                    pc = 0;
+                    frame = callee;
+                } else if (function->type == PRIMITIVE_TYPE) {
+                    Value *result = callPrimitive(function, count);
+                    sp -= count + 1;
+                    push(result);
+                } else {
+                    evaluationError();
+                }
+                break;
+            }
+            case RETURN_OP:
+                if (returnCount == base) {
+                    if (profiling) {
+                        profileUnwind(profileBase);
+                    }
+                    return stack[--sp];
+                } else {
+                    if (profiling) {
+                        profileReturn();
+                    }
+                    returnCount--;
+                    code = returns[returnCount].code;
+                    ops = code->ops;
+                    pc = returns[returnCount].pc;
+                    frame = returns[returnCount].frame;
+                }
+                break;
+            case ERROR_OP:
+            default:
+                evaluationError();
+        }
+    }
+}
+
+Value *execute(Value *expr, Frame *frame) {
+    setCollectionHook(clearPopped);
+    return run(compile(expr), frame);
+}
+
+// Runs the compiled body of a closure
+static Value *callCompiled(Value *closure, Frame *frame) {
+    return run(bodyOf(closure), frame);
+}
+
+Engine virtualMachine = {execute, callCompiled};
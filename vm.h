@@ -0,0 +1,31 @@
+#include "value.h"
+#include "interpreter.h"
+
+#ifndef _VM
+#define _VM
+
+// Compiled code: a sequence of instructions (see vm.c), each an opcode
+// followed by its operands, and the constants the instructions refer to by
+// index. The body of a lambda is compiled once, the first time it is called,
+// and kept with its scope.
+struct Code {
+    int *ops;
+    int length;
+    Value **constants;
+};
+
+typedef struct Code Code;
+
+// Compiles a resolved expression into code that leaves its value on the
+// stack and returns
+Code *compile(Value *expr);
+
+// The bytecode execution engine. Compiles a resolved top-level expression
+// and runs it on the virtual machine, in the given frame. Produces the same
+// values and errors as eval.
+Value *execute(Value *expr, Frame *frame);
+
+// The bytecode engine, which runs expressions with execute
+extern Engine virtualMachine;
+
+#endif